@@ -0,0 +1,148 @@
+#include "allocs.h"
+
+#include <dlfcn.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <iostream>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// A power of two. Sites past the table's capacity go uncounted.
+const size_t kMaxSites = 4096;
+
+struct AllocationSites {
+  void* addresses[kMaxSites];
+  uint64_t counts[kMaxSites];
+  size_t size;
+};
+
+thread_local uint64_t allocations = 0;
+thread_local bool track_sites = false;
+// Zero-initialized, since nothing may be allocated while allocating.
+thread_local AllocationSites sites;
+
+void CountAllocation(void* site) {
+  ++allocations;
+  if (!track_sites) {
+    return;
+  }
+  size_t slot = (reinterpret_cast<uintptr_t>(site) >> 2) & (kMaxSites - 1);
+  for (size_t probe = 0; probe < kMaxSites; ++probe) {
+    size_t i = (slot + probe) & (kMaxSites - 1);
+    if (sites.addresses[i] == site) {
+      ++sites.counts[i];
+      return;
+    }
+    if (sites.addresses[i] == nullptr) {
+      if (sites.size >= kMaxSites / 2) {
+        return;
+      }
+      sites.addresses[i] = site;
+      sites.counts[i] = 1;
+      ++sites.size;
+      return;
+    }
+  }
+}
+
+void* Allocate(size_t size) {
+  void* pointer = std::malloc(size == 0 ? 1 : size);
+  if (pointer == nullptr) {
+    throw std::bad_alloc();
+  }
+  return pointer;
+}
+
+void* AllocateAligned(size_t size, std::align_val_t alignment) {
+  size_t align = static_cast<size_t>(alignment);
+  // aligned_alloc wants a multiple of the alignment.
+  void* pointer = std::aligned_alloc(align, (size + align - 1) / align * align);
+  if (pointer == nullptr) {
+    throw std::bad_alloc();
+  }
+  return pointer;
+}
+
+}  // namespace
+
+void* operator new(size_t size) {
+  CountAllocation(__builtin_return_address(0));
+  return Allocate(size);
+}
+
+void* operator new[](size_t size) {
+  CountAllocation(__builtin_return_address(0));
+  return Allocate(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+  CountAllocation(__builtin_return_address(0));
+  return AllocateAligned(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+  CountAllocation(__builtin_return_address(0));
+  return AllocateAligned(size, alignment);
+}
+
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete[](void* pointer) noexcept { std::free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept {
+  std::free(pointer);
+}
+void operator delete[](void* pointer, std::align_val_t) noexcept {
+  std::free(pointer);
+}
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept {
+  std::free(pointer);
+}
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept {
+  std::free(pointer);
+}
+
+uint64_t AllocationCount() { return allocations; }
+
+void TrackAllocationSites(bool enabled) { track_sites = enabled; }
+
+void PrintAllocationSites(int n, std::ostream& out) {
+  bool tracking = track_sites;
+  track_sites = false;
+  std::vector<std::pair<uint64_t, void*>> ranked;
+  for (size_t i = 0; i < kMaxSites; ++i) {
+    if (sites.addresses[i] != nullptr) {
+      ranked.emplace_back(sites.counts[i], sites.addresses[i]);
+    }
+  }
+  std::sort(ranked.rbegin(), ranked.rend());
+  ranked.resize(std::min<size_t>(ranked.size(), std::max(n, 0)));
+  for (auto [count, address] : ranked) {
+    out << count << " ";
+    Dl_info info;
+    if (dladdr(address, &info) == 0) {
+      out << address << std::endl;
+      continue;
+    }
+    if (info.dli_sname != nullptr) {
+      int status;
+      char* name = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+      out << (status == 0 ? name : info.dli_sname) << "+0x" << std::hex
+          << static_cast<char*>(address) - static_cast<char*>(info.dli_saddr)
+          << std::dec << std::endl;
+      std::free(name);
+    } else {
+      out << info.dli_fname << "+0x" << std::hex
+          << static_cast<char*>(address) - static_cast<char*>(info.dli_fbase)
+          << std::dec << std::endl;
+    }
+  }
+  sites = AllocationSites();
+  track_sites = tracking;
+}
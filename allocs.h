@@ -0,0 +1,24 @@
+#ifndef ALLOCS_H_
+#define ALLOCS_H_
+
+#include <cstdint>
+#include <iostream>
+
+// allocs.cc replaces the global operator new and delete of every binary it's
+// linked into, so that tests and benchmarks can see how much the code they
+// run allocates. Counts are per thread, and cost an increment per
+// allocation.
+
+// The calls to operator new made by this thread so far.
+uint64_t AllocationCount();
+
+// While enabled, this thread's allocations are also counted by the address
+// they were called from, which costs a hash table lookup per allocation.
+void TrackAllocationSites(bool enabled);
+
+// Prints the `n` call sites with the most allocations on this thread, with
+// their symbols when the binary exports them (-rdynamic), or otherwise the
+// offsets to look up with addr2line. Then forgets them.
+void PrintAllocationSites(int n, std::ostream& out);
+
+#endif  // ALLOCS_H_
@@ -0,0 +1,439 @@
+#include "batch.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+#include "board.h"
+#include "color.h"
+#include "common.h"
+#include "move.h"
+#include "piece.h"
+#include "score.h"
+#include "simd.h"
+
+namespace {
+
+// Boards laid out at once, and the multiple the lanes are padded to so every
+// kernel works on whole vectors.
+const int kLanes = 256;
+const int kLaneMultiple = 32;
+
+const Score kMobilityWeight = 4;
+
+// Centipawns for the side owning the piece, from white's point of view with
+// the eighth rank first.
+const int8_t kPieceSquare[6][64] = {
+  {  0,   0,   0,   0,   0,   0,   0,   0,
+    50,  50,  50,  50,  50,  50,  50,  50,
+    10,  10,  20,  30,  30,  20,  10,  10,
+     5,   5,  10,  25,  25,  10,   5,   5,
+     0,   0,   0,  20,  20,   0,   0,   0,
+     5,  -5, -10,   0,   0, -10,  -5,   5,
+     5,  10,  10, -20, -20,  10,  10,   5,
+     0,   0,   0,   0,   0,   0,   0,   0},
+  {-50, -40, -30, -30, -30, -30, -40, -50,
+   -40, -20,   0,   0,   0,   0, -20, -40,
+   -30,   0,  10,  15,  15,  10,   0, -30,
+   -30,   5,  15,  20,  20,  15,   5, -30,
+   -30,   0,  15,  20,  20,  15,   0, -30,
+   -30,   5,  10,  15,  15,  10,   5, -30,
+   -40, -20,   0,   5,   5,   0, -20, -40,
+   -50, -40, -30, -30, -30, -30, -40, -50},
+  {-20, -10, -10, -10, -10, -10, -10, -20,
+   -10,   0,   0,   0,   0,   0,   0, -10,
+   -10,   0,   5,  10,  10,   5,   0, -10,
+   -10,   5,   5,  10,  10,   5,   5, -10,
+   -10,   0,  10,  10,  10,  10,   0, -10,
+   -10,  10,  10,  10,  10,  10,  10, -10,
+   -10,   5,   0,   0,   0,   0,   5, -10,
+   -20, -10, -10, -10, -10, -10, -10, -20},
+  {  0,   0,   0,   0,   0,   0,   0,   0,
+     5,  10,  10,  10,  10,  10,  10,   5,
+    -5,   0,   0,   0,   0,   0,   0,  -5,
+    -5,   0,   0,   0,   0,   0,   0,  -5,
+    -5,   0,   0,   0,   0,   0,   0,  -5,
+    -5,   0,   0,   0,   0,   0,   0,  -5,
+    -5,   0,   0,   0,   0,   0,   0,  -5,
+     0,   0,   0,   5,   5,   0,   0,   0},
+  {-20, -10, -10,  -5,  -5, -10, -10, -20,
+   -10,   0,   0,   0,   0,   0,   0, -10,
+   -10,   0,   5,   5,   5,   5,   0, -10,
+    -5,   0,   5,   5,   5,   5,   0,  -5,
+     0,   0,   5,   5,   5,   5,   0,  -5,
+   -10,   5,   5,   5,   5,   5,   0, -10,
+   -10,   0,   5,   0,   0,   0,   0, -10,
+   -20, -10, -10,  -5,  -5, -10, -10, -20},
+  {-30, -40, -40, -50, -50, -40, -40, -30,
+   -30, -40, -40, -50, -50, -40, -40, -30,
+   -30, -40, -40, -50, -50, -40, -40, -30,
+   -30, -40, -40, -50, -50, -40, -40, -30,
+   -20, -30, -30, -40, -40, -30, -30, -20,
+   -10, -20, -20, -20, -20, -20, -20, -10,
+    20,  20,   0,   0,   0,   0,  20,  20,
+    20,  30,  10,   0,   0,  10,  30,  20},
+};
+
+// Same as Piece::Value.
+const int8_t kPieceValue[6] = {1, 3, 3, 5, 9, 1};
+
+// Squares are numbered y * 8 + x. A piece code is 0 for an empty square, then
+// 1 to 6 for the white pieces and 7 to 12 for the black ones, in PieceType
+// order. The tables are indexed by piece code, 16 entries wide so that a
+// byte shuffle can look up a whole vector of codes at once.
+struct Tables {
+  alignas(16) int8_t material[16];
+  alignas(16) int8_t piece_square[64][16];
+};
+
+Tables MakeTables() {
+  Tables tables = {};
+  for (int type = 0; type < 6; ++type) {
+    tables.material[1 + type] = kPieceValue[type];
+    tables.material[7 + type] = -kPieceValue[type];
+    for (int y = 0; y <= 7; ++y) {
+      for (int x = 0; x <= 7; ++x) {
+        tables.piece_square[y * 8 + x][1 + type] =
+            kPieceSquare[type][(7 - y) * 8 + x];
+        tables.piece_square[y * 8 + x][7 + type] =
+            -kPieceSquare[type][y * 8 + x];
+      }
+    }
+  }
+  return tables;
+}
+
+const Tables& GetTables() {
+  static const Tables tables = MakeTables();
+  return tables;
+}
+
+struct Layout {
+  alignas(32) uint8_t codes[64][kLanes];
+  // Bitboards by color.
+  alignas(32) uint64_t own[2][kLanes];
+  alignas(32) uint64_t knights[2][kLanes];
+  alignas(32) uint64_t diagonal[2][kLanes];    // Bishops and queens.
+  alignas(32) uint64_t orthogonal[2][kLanes];  // Rooks and queens.
+  // Outputs, white minus black.
+  alignas(32) int16_t material[kLanes];
+  alignas(32) int16_t piece_square[kLanes];
+  alignas(32) int16_t mobility[kLanes];
+};
+
+void Fill(Layout& layout, std::span<const Board> boards, int lanes) {
+  for (int square = 0; square < 64; ++square) {
+    std::memset(layout.codes[square], 0, lanes);
+  }
+  for (auto bitboards : {layout.own, layout.knights, layout.diagonal,
+                         layout.orthogonal}) {
+    for (Color color : {kWhite, kBlack}) {
+      std::fill(bitboards[color], bitboards[color] + lanes, 0);
+    }
+  }
+  for (size_t lane = 0; lane < boards.size(); ++lane) {
+    for (int y = 0; y <= 7; ++y) {
+      for (int x = 0; x <= 7; ++x) {
+        const Piece* piece = boards[lane].GetPiece({x, y});
+        if (piece == nullptr) {
+          continue;
+        }
+        int square = y * 8 + x;
+        uint64_t bit = uint64_t(1) << square;
+        Color color = piece->GetColor();
+        PieceType type = piece->Type();
+        layout.codes[square][lane] =
+            1 + static_cast<int>(type) + (color == kWhite ? 0 : 6);
+        layout.own[color][lane] |= bit;
+        if (type == PieceType::kKnight) {
+          layout.knights[color][lane] |= bit;
+        }
+        if (type == PieceType::kBishop || type == PieceType::kQueen) {
+          layout.diagonal[color][lane] |= bit;
+        }
+        if (type == PieceType::kRook || type == PieceType::kQueen) {
+          layout.orthogonal[color][lane] |= bit;
+        }
+      }
+    }
+  }
+}
+
+void MaterialAndPieceSquareScalar(Layout& layout, int lanes) {
+  const Tables& tables = GetTables();
+  for (int lane = 0; lane < lanes; ++lane) {
+    int16_t material = 0;
+    int16_t piece_square = 0;
+    for (int square = 0; square < 64; ++square) {
+      uint8_t code = layout.codes[square][lane];
+      material += tables.material[code];
+      piece_square += tables.piece_square[square][code];
+    }
+    layout.material[lane] = material;
+    layout.piece_square[lane] = piece_square;
+  }
+}
+
+// The bitboard kernels are written once over a type with the integer
+// operators: uint64_t for one board, or a vector of them. They are always
+// inlined into a function compiled for the vector's instruction set, so no
+// vector is passed across a call.
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+const uint64_t kNotFileA = 0xfefefefefefefefe;
+const uint64_t kNotFileAB = 0xfcfcfcfcfcfcfcfc;
+const uint64_t kNotFileH = 0x7f7f7f7f7f7f7f7f;
+const uint64_t kNotFileGH = 0x3f3f3f3f3f3f3f3f;
+
+template <int S, typename V>
+__attribute__((always_inline)) inline V Shift(V bitboard) {
+  if constexpr (S > 0) {
+    return bitboard << S;
+  } else {
+    return bitboard >> -S;
+  }
+}
+
+template <typename V>
+__attribute__((always_inline)) inline V Load(const uint64_t* bitboards) {
+  V value;
+  std::memcpy(&value, bitboards, sizeof(value));
+  return value;
+}
+
+template <typename V>
+__attribute__((always_inline)) inline V KnightAttacks(V knights) {
+  V one = ((knights >> 1) & kNotFileH) | ((knights << 1) & kNotFileA);
+  V two = ((knights >> 2) & kNotFileGH) | ((knights << 2) & kNotFileAB);
+  return (one << 16) | (one >> 16) | (two << 8) | (two >> 8);
+}
+
+// Kogge-Stone fill in one direction, stopping at the first occupied square.
+// `mask` drops the squares that wrapped around the board's edge.
+template <int S, typename V>
+__attribute__((always_inline)) inline V SlideAttacks(V sliders, V empty,
+                                                     uint64_t mask) {
+  V propagators = empty & mask;
+  sliders |= propagators & Shift<S>(sliders);
+  propagators &= Shift<S>(propagators);
+  sliders |= propagators & Shift<2 * S>(sliders);
+  propagators &= Shift<2 * S>(propagators);
+  sliders |= propagators & Shift<4 * S>(sliders);
+  return Shift<S>(sliders) & mask;
+}
+
+template <typename V>
+__attribute__((always_inline)) inline V Attacks(V knights, V diagonal,
+                                                V orthogonal, V empty) {
+  return KnightAttacks(knights) |
+         SlideAttacks<9>(diagonal, empty, kNotFileA) |
+         SlideAttacks<7>(diagonal, empty, kNotFileH) |
+         SlideAttacks<-7>(diagonal, empty, kNotFileA) |
+         SlideAttacks<-9>(diagonal, empty, kNotFileH) |
+         SlideAttacks<1>(orthogonal, empty, kNotFileA) |
+         SlideAttacks<-1>(orthogonal, empty, kNotFileH) |
+         SlideAttacks<8>(orthogonal, empty, ~uint64_t(0)) |
+         SlideAttacks<-8>(orthogonal, empty, ~uint64_t(0));
+}
+
+// Squares attacked by knights, bishops, rooks and queens and not occupied by
+// their own side.
+template <typename V>
+__attribute__((always_inline)) inline void MobilityKernel(Layout& layout,
+                                                          int lanes) {
+  const int width = sizeof(V) / sizeof(uint64_t);
+  for (int lane = 0; lane < lanes; lane += width) {
+    V own[2] = {Load<V>(&layout.own[kWhite][lane]),
+                Load<V>(&layout.own[kBlack][lane])};
+    V empty = ~(own[kWhite] | own[kBlack]);
+    uint64_t targets[2][width];
+    for (Color color : {kWhite, kBlack}) {
+      V attacks = Attacks(Load<V>(&layout.knights[color][lane]),
+                          Load<V>(&layout.diagonal[color][lane]),
+                          Load<V>(&layout.orthogonal[color][lane]), empty);
+      attacks &= ~own[color];
+      std::memcpy(targets[color], &attacks, sizeof(attacks));
+    }
+    for (int i = 0; i < width; ++i) {
+      layout.mobility[lane + i] =
+          std::popcount(targets[kWhite][i]) - std::popcount(targets[kBlack][i]);
+    }
+  }
+}
+
+void MobilityScalar(Layout& layout, int lanes) {
+  MobilityKernel<uint64_t>(layout, lanes);
+}
+
+#ifdef SIMD_X86
+
+typedef uint64_t Uint64x2 __attribute__((vector_size(16)));
+typedef uint64_t Uint64x4 __attribute__((vector_size(32)));
+
+__attribute__((target("sse4.1")))
+void MaterialAndPieceSquareSse41(Layout& layout, int lanes) {
+  const Tables& tables = GetTables();
+  const __m128i material_table =
+      _mm_load_si128(reinterpret_cast<const __m128i*>(tables.material));
+  for (int lane = 0; lane < lanes; lane += 16) {
+    __m128i material[2] = {_mm_setzero_si128(), _mm_setzero_si128()};
+    __m128i piece_square[2] = {_mm_setzero_si128(), _mm_setzero_si128()};
+    for (int square = 0; square < 64; ++square) {
+      __m128i codes = _mm_load_si128(
+          reinterpret_cast<const __m128i*>(&layout.codes[square][lane]));
+      __m128i m = _mm_shuffle_epi8(material_table, codes);
+      __m128i p = _mm_shuffle_epi8(
+          _mm_load_si128(
+              reinterpret_cast<const __m128i*>(tables.piece_square[square])),
+          codes);
+      material[0] = _mm_add_epi16(material[0], _mm_cvtepi8_epi16(m));
+      material[1] = _mm_add_epi16(material[1],
+                                  _mm_cvtepi8_epi16(_mm_srli_si128(m, 8)));
+      piece_square[0] = _mm_add_epi16(piece_square[0], _mm_cvtepi8_epi16(p));
+      piece_square[1] = _mm_add_epi16(piece_square[1],
+                                      _mm_cvtepi8_epi16(_mm_srli_si128(p, 8)));
+    }
+    for (int half = 0; half < 2; ++half) {
+      _mm_store_si128(
+          reinterpret_cast<__m128i*>(&layout.material[lane + 8 * half]),
+          material[half]);
+      _mm_store_si128(
+          reinterpret_cast<__m128i*>(&layout.piece_square[lane + 8 * half]),
+          piece_square[half]);
+    }
+  }
+}
+
+__attribute__((target("sse4.1")))
+void MobilitySse41(Layout& layout, int lanes) {
+  MobilityKernel<Uint64x2>(layout, lanes);
+}
+
+__attribute__((target("avx2")))
+void MaterialAndPieceSquareAvx2(Layout& layout, int lanes) {
+  const Tables& tables = GetTables();
+  // Byte shuffles look up each 128-bit half separately, so both halves get a
+  // copy of the table.
+  const __m256i material_table = _mm256_broadcastsi128_si256(
+      _mm_load_si128(reinterpret_cast<const __m128i*>(tables.material)));
+  for (int lane = 0; lane < lanes; lane += 32) {
+    __m256i material[2] = {_mm256_setzero_si256(), _mm256_setzero_si256()};
+    __m256i piece_square[2] = {_mm256_setzero_si256(), _mm256_setzero_si256()};
+    for (int square = 0; square < 64; ++square) {
+      __m256i codes = _mm256_load_si256(
+          reinterpret_cast<const __m256i*>(&layout.codes[square][lane]));
+      __m256i m = _mm256_shuffle_epi8(material_table, codes);
+      __m256i p = _mm256_shuffle_epi8(
+          _mm256_broadcastsi128_si256(_mm_load_si128(
+              reinterpret_cast<const __m128i*>(tables.piece_square[square]))),
+          codes);
+      material[0] = _mm256_add_epi16(
+          material[0], _mm256_cvtepi8_epi16(_mm256_castsi256_si128(m)));
+      material[1] = _mm256_add_epi16(
+          material[1], _mm256_cvtepi8_epi16(_mm256_extracti128_si256(m, 1)));
+      piece_square[0] = _mm256_add_epi16(
+          piece_square[0], _mm256_cvtepi8_epi16(_mm256_castsi256_si128(p)));
+      piece_square[1] = _mm256_add_epi16(
+          piece_square[1],
+          _mm256_cvtepi8_epi16(_mm256_extracti128_si256(p, 1)));
+    }
+    for (int half = 0; half < 2; ++half) {
+      _mm256_store_si256(
+          reinterpret_cast<__m256i*>(&layout.material[lane + 16 * half]),
+          material[half]);
+      _mm256_store_si256(
+          reinterpret_cast<__m256i*>(&layout.piece_square[lane + 16 * half]),
+          piece_square[half]);
+    }
+  }
+}
+
+__attribute__((target("avx2")))
+void MobilityAvx2(Layout& layout, int lanes) {
+  MobilityKernel<Uint64x4>(layout, lanes);
+}
+
+#endif  // SIMD_X86
+
+void MaterialAndPieceSquare(SimdLevel simd, Layout& layout, int lanes) {
+  switch (simd) {
+#ifdef SIMD_X86
+    case SimdLevel::kAvx2:
+      return MaterialAndPieceSquareAvx2(layout, lanes);
+    case SimdLevel::kSse41:
+      return MaterialAndPieceSquareSse41(layout, lanes);
+#endif
+    default:
+      return MaterialAndPieceSquareScalar(layout, lanes);
+  }
+}
+
+void Mobility(SimdLevel simd, Layout& layout, int lanes) {
+  switch (simd) {
+#ifdef SIMD_X86
+    case SimdLevel::kAvx2:
+      return MobilityAvx2(layout, lanes);
+    case SimdLevel::kSse41:
+      return MobilitySse41(layout, lanes);
+#endif
+    default:
+      return MobilityScalar(layout, lanes);
+  }
+}
+
+}  // namespace
+
+void EvaluateBatch(std::span<const Board> boards, std::span<Score> scores) {
+  EvaluateBatch(boards, scores, DetectSimdLevel());
+}
+
+void EvaluateBatch(std::span<const Board> boards, std::span<Score> scores,
+                   SimdLevel simd) {
+  // Too large for the stack, and reused to avoid allocating on every call.
+  thread_local Layout layout;
+  for (size_t start = 0; start < boards.size(); start += kLanes) {
+    auto chunk = boards.subspan(start, std::min<size_t>(kLanes,
+                                                        boards.size() - start));
+    int lanes = (chunk.size() + kLaneMultiple - 1) / kLaneMultiple *
+                kLaneMultiple;
+    Fill(layout, chunk, lanes);
+    MaterialAndPieceSquare(simd, layout, lanes);
+    Mobility(simd, layout, lanes);
+    for (size_t lane = 0; lane < chunk.size(); ++lane) {
+      scores[start + lane] = layout.material[lane] * kCentipawnsPerPawn +
+                             layout.piece_square[lane] +
+                             layout.mobility[lane] * kMobilityWeight;
+    }
+  }
+}
+
+BatchUtility::BatchUtility() : BatchUtility(DetectSimdLevel()) {}
+
+BatchUtility::BatchUtility(SimdLevel simd) : simd_(simd) {}
+
+Score BatchUtility::Evaluate(const Board& board, Color attackingcolor) {
+  switch (board.GetGameOutcome()) {
+    case kCheckmate:
+      return MateScore(attackingcolor, 0);
+    case kDraw:
+      return 0;
+    default:
+      Score score;
+      ::EvaluateBatch({&board, 1}, {&score, 1}, simd_);
+      return score;
+  }
+}
+
+void BatchUtility::EvaluateBatch(std::span<const Board> boards,
+                                 std::span<Score> scores) {
+  ::EvaluateBatch(boards, scores, simd_);
+}
+
+void BatchUtility::Reset(unused const Board& board) {}
+
+void BatchUtility::DoMove(unused const Board& board, unused const Move& move) {}
+
+void BatchUtility::UndoMove(unused const Board& board,
+                            unused const Move& move) {}
@@ -0,0 +1,37 @@
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include <span>
+
+#include "board.h"
+#include "color.h"
+#include "move.h"
+#include "score.h"
+#include "simd.h"
+
+// Scores boards by material, piece-square tables and mobility, many at a time.
+// The boards are laid out structure-of-arrays, one lane per board, so every
+// term is computed for a whole vector of boards at once. Game outcomes are
+// not checked. `scores` must be as long as `boards`.
+void EvaluateBatch(std::span<const Board> boards, std::span<Score> scores);
+void EvaluateBatch(std::span<const Board> boards, std::span<Score> scores,
+                   SimdLevel simd);
+
+// An evaluator based on EvaluateBatch. The search evaluates all the children
+// of a node right above the horizon in one batch.
+class BatchUtility {
+ public:
+  BatchUtility();
+  explicit BatchUtility(SimdLevel simd);
+
+  Score Evaluate(const Board& board, Color attackingcolor);
+  void EvaluateBatch(std::span<const Board> boards, std::span<Score> scores);
+  void Reset(const Board& board);
+  void DoMove(const Board& board, const Move& move);
+  void UndoMove(const Board& board, const Move& move);
+
+ private:
+  SimdLevel simd_;
+};
+
+#endif  // BATCH_H_
@@ -0,0 +1,28 @@
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <cstdint>
+#include <iostream>
+
+#include "board.h"
+#include "engine.h"
+
+const int kBenchDepth = 1;
+const int kPerftDepth = 4;
+
+// Searches a fixed set of positions to `depth`, each with an empty cache, and
+// prints the node count of each and the totals to `out`, with the heap
+// allocations and the hardware counters per node. The node count only changes
+// with the search and the evaluation, so it works as a signature of both.
+// Returns the total node count.
+uint64_t RunBench(int depth, const AnyUtility& utility,
+                  std::ostream& out = std::cout);
+
+// The number of legal move sequences `depth` plies long.
+uint64_t Perft(const Board& board, int depth);
+
+// Counts the move sequences from the starting position, and prints the count,
+// the speed and the hardware counters per node to `out`. Returns the count.
+uint64_t RunPerft(int depth, std::ostream& out = std::cout);
+
+#endif  // BENCH_H_
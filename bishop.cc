@@ -9,6 +9,8 @@
 #include "piece.h"
 #include "position.h"
 
+Bishop::Bishop(Color color) : Piece(color, PieceType::kBishop) {}
+
 std::string Bishop::String() const { return GetColor() == kWhite ? "♗" : "♝"; }
 
 std::vector<Position> Bishop::GetMoves(const Board& board,
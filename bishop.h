@@ -11,7 +11,7 @@
 
 class Bishop : public Piece {
  public:
-  using Piece::Piece;
+  explicit Bishop(Color color);
 
   std::string String() const override;
 
@@ -0,0 +1,645 @@
+#include "bitbase.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "board.h"
+#include "color.h"
+#include "piece.h"
+#include "position.h"
+#include "score.h"
+
+namespace {
+
+enum Ending { kKpk, kKrk, kKqk, kKbnk, kNumEndings };
+
+// The pieces of the side that can win, besides its king, in table order.
+const std::vector<PieceType> kEndingPieces[kNumEndings] = {
+  {PieceType::kPawn},
+  {PieceType::kRook},
+  {PieceType::kQueen},
+  {PieceType::kBishop, PieceType::kKnight},
+};
+
+const int kMaxPieces = 2;
+
+// Squares are numbered a1, b1, ..., h8. The tables are built for white as
+// the side that can win; black's are looked up with the board flipped.
+int File(int square) {
+  return square & 7;
+}
+
+int Rank(int square) {
+  return square >> 3;
+}
+
+int Square(int file, int rank) {
+  return 8 * rank + file;
+}
+
+uint64_t Bit(int square) {
+  return uint64_t(1) << square;
+}
+
+int Distance(int a, int b) {
+  return std::max(std::abs(File(a) - File(b)), std::abs(Rank(a) - Rank(b)));
+}
+
+int Sign(int x) {
+  return (x > 0) - (x < 0);
+}
+
+// Pawnless endings are the same flipped or mirrored along a diagonal, so the
+// strong king is kept within a1-d1-d4.
+const int kTriangle[10] = {0, 1, 2, 3, 9, 10, 11, 18, 19, 27};
+
+int Transform(int square, bool flip_file, bool flip_rank, bool transpose) {
+  int x = flip_file ? 7 - File(square) : File(square);
+  int y = flip_rank ? 7 - Rank(square) : Rank(square);
+  return transpose ? Square(y, x) : Square(x, y);
+}
+
+// What the generators look up millions of times.
+struct Geometry {
+  Geometry();
+
+  // The squares strictly between two on a rank, file or diagonal.
+  uint64_t between[64][64];
+  bool orthogonal[64][64];
+  bool diagonal[64][64];
+  // Where each square goes when the board is flipped and transposed to
+  // bring the strong king, on the first square, into a1-d1-d4.
+  int8_t canonical[64][64];
+  // The index of squares within a1-d1-d4.
+  int8_t triangle[64];
+};
+
+Geometry::Geometry() {
+  for (int from = 0; from < 64; ++from) {
+    for (int to = 0; to < 64; ++to) {
+      int dx = File(to) - File(from);
+      int dy = Rank(to) - Rank(from);
+      orthogonal[from][to] = from != to && (dx == 0 || dy == 0);
+      diagonal[from][to] = from != to && std::abs(dx) == std::abs(dy);
+      between[from][to] = 0;
+      if (orthogonal[from][to] || diagonal[from][to]) {
+        int step = 8 * Sign(dy) + Sign(dx);
+        for (int square = from + step; square != to; square += step) {
+          between[from][to] |= Bit(square);
+        }
+      }
+    }
+    bool flip_file = File(from) > 3;
+    bool flip_rank = Rank(from) > 3;
+    int king = Transform(from, flip_file, flip_rank, false);
+    bool transpose = Rank(king) > File(king);
+    for (int square = 0; square < 64; ++square) {
+      canonical[from][square] =
+          Transform(square, flip_file, flip_rank, transpose);
+    }
+    triangle[from] = std::find(kTriangle, kTriangle + 10, from) - kTriangle;
+  }
+}
+
+const Geometry kGeometry;
+
+// Whether a piece of `type` on `from` attacks `to`, with sliders blocked by
+// `occupied`. Pawns are white's.
+bool Attacks(PieceType type, int from, int to, uint64_t occupied) {
+  int dx = File(to) - File(from);
+  int dy = Rank(to) - Rank(from);
+  switch (type) {
+    case PieceType::kKing:
+      return std::max(std::abs(dx), std::abs(dy)) == 1;
+    case PieceType::kKnight:
+      return std::abs(dx * dy) == 2;
+    case PieceType::kPawn:
+      return dy == 1 && std::abs(dx) == 1;
+    case PieceType::kBishop:
+      return kGeometry.diagonal[from][to] &&
+             !(kGeometry.between[from][to] & occupied);
+    case PieceType::kRook:
+      return kGeometry.orthogonal[from][to] &&
+             !(kGeometry.between[from][to] & occupied);
+    case PieceType::kQueen:
+      return (kGeometry.orthogonal[from][to] || kGeometry.diagonal[from][to]) &&
+             !(kGeometry.between[from][to] & occupied);
+  }
+  return false;
+}
+
+const int kKingSteps[8][2] = {{-1, -1}, {0, -1}, {1, -1}, {-1, 0},
+                              {1, 0},   {-1, 1}, {0, 1},  {1, 1}};
+const int kKnightSteps[8][2] = {{1, 2},   {2, 1},   {2, -1}, {1, -2},
+                                {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2}};
+
+// Calls `visit` with every empty square a king, knight, bishop, rook or
+// queen on `from` moves to, sliders stopping at `occupied`. Without pawns
+// and captures, these are also the squares it can have come from.
+template <typename Visit>
+void ForEachMove(PieceType type, int from, uint64_t occupied, Visit visit) {
+  bool slides = type == PieceType::kBishop || type == PieceType::kRook ||
+                type == PieceType::kQueen;
+  const int(*steps)[2] = type == PieceType::kKnight ? kKnightSteps : kKingSteps;
+  for (int i = 0; i < 8; ++i) {
+    int dx = steps[i][0];
+    int dy = steps[i][1];
+    if ((type == PieceType::kBishop && (dx == 0 || dy == 0)) ||
+        (type == PieceType::kRook && dx != 0 && dy != 0)) {
+      continue;
+    }
+    int x = File(from) + dx;
+    int y = Rank(from) + dy;
+    while (x >= 0 && x < 8 && y >= 0 && y < 8 &&
+           !(occupied & Bit(Square(x, y)))) {
+      visit(Square(x, y));
+      if (!slides) {
+        break;
+      }
+      x += dx;
+      y += dy;
+    }
+  }
+}
+
+bool IsSet(const std::vector<uint64_t>& bits, size_t index) {
+  return bits[index / 64] >> (index % 64) & 1;
+}
+
+// Calls `work` with each of [0, size) and a list to add to, spread over the
+// cores, and returns the lists joined.
+template <typename Work>
+std::vector<size_t> ParallelCollect(size_t size, Work work) {
+  size_t threads = std::clamp<size_t>(size / 1024, 1,
+                                      std::max(1u, std::thread::hardware_concurrency()));
+  std::vector<std::vector<size_t>> found(threads);
+  std::vector<std::thread> workers;
+  size_t chunk = (size + threads - 1) / threads;
+  for (size_t thread = 0; thread < threads; ++thread) {
+    workers.emplace_back([&, thread]() {
+      size_t end = std::min(size, (thread + 1) * chunk);
+      for (size_t i = thread * chunk; i < end; ++i) {
+        work(i, found[thread]);
+      }
+    });
+  }
+  std::vector<size_t> joined;
+  for (size_t thread = 0; thread < threads; ++thread) {
+    workers[thread].join();
+    joined.insert(joined.end(), found[thread].begin(), found[thread].end());
+  }
+  return joined;
+}
+
+struct Setup {
+  int weak_to_move;
+  int king;
+  int weak_king;
+  int pieces[kMaxPieces];
+};
+
+void Canonicalize(Setup& setup, int num_pieces) {
+  const int8_t* canonical = kGeometry.canonical[setup.king];
+  setup.king = canonical[setup.king];
+  setup.weak_king = canonical[setup.weak_king];
+  for (int i = 0; i < num_pieces; ++i) {
+    setup.pieces[i] = canonical[setup.pieces[i]];
+  }
+}
+
+// The side to move first, so that the weak side's positions are the upper
+// half of the table.
+size_t Index(const Setup& setup, int num_pieces) {
+  size_t index = setup.weak_to_move * 10 + kGeometry.triangle[setup.king];
+  index = index * 64 + setup.weak_king;
+  for (int i = 0; i < num_pieces; ++i) {
+    index = index * 64 + setup.pieces[i];
+  }
+  return index;
+}
+
+Setup FromIndex(size_t index, int num_pieces) {
+  Setup setup;
+  for (int i = num_pieces - 1; i >= 0; --i) {
+    setup.pieces[i] = index % 64;
+    index /= 64;
+  }
+  setup.weak_king = index % 64;
+  index /= 64;
+  setup.king = kTriangle[index % 10];
+  setup.weak_to_move = index / 10;
+  return setup;
+}
+
+uint64_t Occupied(const Setup& setup, int num_pieces) {
+  uint64_t occupied = Bit(setup.king) | Bit(setup.weak_king);
+  for (int i = 0; i < num_pieces; ++i) {
+    occupied |= Bit(setup.pieces[i]);
+  }
+  return occupied;
+}
+
+// Whether the strong side's pieces, but the one numbered `skip`, attack
+// `target`.
+bool Attacked(const std::vector<PieceType>& types, const Setup& setup,
+              int target, uint64_t occupied, int skip = -1) {
+  for (size_t i = 0; i < types.size(); ++i) {
+    if (static_cast<int>(i) != skip &&
+        Attacks(types[i], setup.pieces[i], target, occupied)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Marks positions the weak side draws however the other plays.
+const uint8_t kNever = 255;
+
+// The weak king's moves, for a position with it to move, or kNever if it
+// can take a piece, is stalemated or the position is impossible. Sets
+// `mated` if it has no moves because it's checkmated.
+uint8_t CountEscapes(const std::vector<PieceType>& types, const Setup& setup,
+                     bool& mated) {
+  int num_pieces = types.size();
+  uint64_t occupied = Occupied(setup, num_pieces);
+  if (__builtin_popcountll(occupied) != num_pieces + 2 ||
+      Distance(setup.king, setup.weak_king) <= 1) {
+    return kNever;
+  }
+  uint64_t without_king = occupied & ~Bit(setup.weak_king);
+  int moves = 0;
+  bool captures = false;
+  ForEachMove(PieceType::kKing, setup.weak_king, 0, [&](int to) {
+    if (Distance(to, setup.king) <= 1) {
+      return;
+    }
+    int captured = -1;
+    for (int i = 0; i < num_pieces; ++i) {
+      if (setup.pieces[i] == to) {
+        captured = i;
+      }
+    }
+    if (!Attacked(types, setup, to, without_king, captured)) {
+      if (captured >= 0) {
+        captures = true;
+      } else {
+        ++moves;
+      }
+    }
+  });
+  if (captures) {
+    return kNever;
+  }
+  if (moves == 0) {
+    mated = Attacked(types, setup, setup.weak_king, occupied);
+    return mated ? 0 : kNever;
+  }
+  return moves;
+}
+
+// Retrograde analysis: starting from the mates, a position with the strong
+// side to move is won once one of its moves leads to a won position, and one
+// with the weak side to move once all of its moves do. Each layer is
+// expanded in parallel, from the positions the last one won.
+std::vector<uint64_t> SolvePawnless(const std::vector<PieceType>& types) {
+  int num_pieces = types.size();
+  size_t half = size_t(10 * 64) << (6 * num_pieces);
+  std::vector<uint64_t> wins((2 * half + 63) / 64);
+  // Moves of the weak king not known to lose yet.
+  std::vector<uint8_t> escapes(half);
+  auto is_won = [&](size_t index) {
+    return std::atomic_ref<uint64_t>(wins[index / 64])
+               .load(std::memory_order_relaxed) >>
+               (index % 64) &
+           1;
+  };
+  // Whether the position wasn't known to be won yet.
+  auto set = [&](size_t index) {
+    uint64_t bit = uint64_t(1) << (index % 64);
+    return !(std::atomic_ref<uint64_t>(wins[index / 64])
+                 .fetch_or(bit, std::memory_order_relaxed) &
+             bit);
+  };
+
+  std::vector<size_t> lost =
+      ParallelCollect(half, [&](size_t i, std::vector<size_t>& mates) {
+        bool mated = false;
+        escapes[i] = CountEscapes(types, FromIndex(half + i, num_pieces), mated);
+        if (mated) {
+          mates.push_back(half + i);
+        }
+      });
+  for (size_t index : lost) {
+    set(index);
+  }
+  while (!lost.empty()) {
+    std::vector<size_t> won =
+        ParallelCollect(lost.size(), [&](size_t i, std::vector<size_t>& found) {
+          Setup after = FromIndex(lost[i], num_pieces);
+          uint64_t occupied = Occupied(after, num_pieces);
+          auto unmove = [&](Setup before) {
+            before.weak_to_move = 0;
+            Canonicalize(before, num_pieces);
+            size_t index = Index(before, num_pieces);
+            // Most positions are already won by the time they're reached
+            // again, which is quicker to tell than whether they're legal.
+            if (is_won(index) ||
+                Attacked(types, before, before.weak_king,
+                         Occupied(before, num_pieces))) {
+              return;
+            }
+            if (set(index)) {
+              found.push_back(index);
+            }
+          };
+          ForEachMove(PieceType::kKing, after.king, occupied, [&](int from) {
+            if (Distance(from, after.weak_king) > 1) {
+              Setup before = after;
+              before.king = from;
+              unmove(before);
+            }
+          });
+          for (int piece = 0; piece < num_pieces; ++piece) {
+            ForEachMove(types[piece], after.pieces[piece], occupied,
+                        [&](int from) {
+              Setup before = after;
+              before.pieces[piece] = from;
+              unmove(before);
+            });
+          }
+        });
+    lost = ParallelCollect(won.size(), [&](size_t i, std::vector<size_t>& found) {
+      Setup after = FromIndex(won[i], num_pieces);
+      ForEachMove(PieceType::kKing, after.weak_king,
+                  Occupied(after, num_pieces), [&](int from) {
+        if (Distance(from, after.king) <= 1) {
+          return;
+        }
+        Setup before = after;
+        before.weak_to_move = 1;
+        before.weak_king = from;
+        size_t index = Index(before, num_pieces);
+        std::atomic_ref<uint8_t> left(escapes[index - half]);
+        if (left.load(std::memory_order_relaxed) != kNever &&
+            left.fetch_sub(1) == 1) {
+          set(index);
+          found.push_back(index);
+        }
+      });
+    });
+  }
+  return wins;
+}
+
+// King and pawn against king, with the pawn on files a-d and ranks 2-7.
+const size_t kKpkSize = 2 * 64 * 64 * 24;
+
+size_t KpkIndex(int weak_to_move, int king, int weak_king, int pawn) {
+  return ((weak_to_move * 64 + king) * 64 + weak_king) * 24 +
+         (Rank(pawn) - 1) * 4 + File(pawn);
+}
+
+enum KpkResult : uint8_t { kUnknown, kWon, kDrawn, kInvalid };
+
+// What's known of a position before looking at its moves. A pawn on the
+// seventh that can promote without the queen being taken wins.
+KpkResult ClassifyKpk(int weak_to_move, int king, int weak_king, int pawn) {
+  if (king == weak_king || king == pawn || weak_king == pawn ||
+      Distance(king, weak_king) <= 1 ||
+      (!weak_to_move && Attacks(PieceType::kPawn, pawn, weak_king, 0))) {
+    return kInvalid;
+  }
+  if (!weak_to_move) {
+    int promotion = pawn + 8;
+    if (Rank(pawn) == 6 && promotion != king && promotion != weak_king &&
+        (Distance(weak_king, promotion) > 1 || Distance(king, promotion) == 1)) {
+      return kWon;
+    }
+    return kUnknown;
+  }
+  if (Distance(weak_king, pawn) == 1 && Distance(king, pawn) > 1) {
+    return kDrawn;
+  }
+  bool moves = false;
+  ForEachMove(PieceType::kKing, weak_king, Bit(pawn), [&](int to) {
+    moves = moves || (Distance(to, king) > 1 &&
+                      !Attacks(PieceType::kPawn, pawn, to, 0));
+  });
+  if (!moves) {
+    return Attacks(PieceType::kPawn, pawn, weak_king, 0) ? kWon : kDrawn;
+  }
+  return kUnknown;
+}
+
+// Its pawn moves aren't reversible, so KPK is solved by going over all
+// positions until no more are decided, as a position with a side to move
+// wins if one of its moves wins and draws if all of them draw. Whatever is
+// left undecided is a draw.
+std::vector<uint64_t> SolveKpk() {
+  std::vector<uint8_t> results(kKpkSize);
+  auto decode = [](size_t index, int& weak_to_move, int& king, int& weak_king,
+                   int& pawn) {
+    pawn = Square(index % 24 % 4, index % 24 / 4 + 1);
+    index /= 24;
+    weak_king = index % 64;
+    index /= 64;
+    king = index % 64;
+    weak_to_move = index / 64;
+  };
+  for (size_t index = 0; index < kKpkSize; ++index) {
+    int weak_to_move, king, weak_king, pawn;
+    decode(index, weak_to_move, king, weak_king, pawn);
+    results[index] = ClassifyKpk(weak_to_move, king, weak_king, pawn);
+  }
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (size_t index = 0; index < kKpkSize; ++index) {
+      if (results[index] != kUnknown) {
+        continue;
+      }
+      int weak_to_move, king, weak_king, pawn;
+      decode(index, weak_to_move, king, weak_king, pawn);
+      // The results the mover is after, and has to avoid.
+      KpkResult good = weak_to_move ? kDrawn : kWon;
+      KpkResult bad = weak_to_move ? kWon : kDrawn;
+      bool any_good = false;
+      bool all_bad = true;
+      auto visit = [&](size_t successor) {
+        any_good = any_good || results[successor] == good;
+        all_bad = all_bad && results[successor] == bad;
+      };
+      if (weak_to_move) {
+        ForEachMove(PieceType::kKing, weak_king, Bit(pawn), [&](int to) {
+          if (Distance(to, king) > 1 && !Attacks(PieceType::kPawn, pawn, to, 0)) {
+            visit(KpkIndex(0, king, to, pawn));
+          }
+        });
+      } else {
+        ForEachMove(PieceType::kKing, king, Bit(pawn), [&](int to) {
+          if (Distance(to, weak_king) > 1) {
+            visit(KpkIndex(1, to, weak_king, pawn));
+          }
+        });
+        int push = pawn + 8;
+        if (Rank(pawn) < 6 && push != king && push != weak_king) {
+          visit(KpkIndex(1, king, weak_king, push));
+          int double_push = push + 8;
+          if (Rank(pawn) == 1 && double_push != king &&
+              double_push != weak_king) {
+            visit(KpkIndex(1, king, weak_king, double_push));
+          }
+        }
+      }
+      if (any_good || all_bad) {
+        results[index] = any_good ? good : bad;
+        changed = true;
+      }
+    }
+  }
+  std::vector<uint64_t> wins((kKpkSize + 63) / 64);
+  for (size_t index = 0; index < kKpkSize; ++index) {
+    if (results[index] == kWon) {
+      wins[index / 64] |= uint64_t(1) << (index % 64);
+    }
+  }
+  return wins;
+}
+
+struct Bitbase {
+  std::once_flag built;
+  std::vector<uint64_t> wins;
+};
+
+Bitbase bitbases[kNumEndings];
+
+const std::vector<uint64_t>& Wins(Ending ending) {
+  Bitbase& bitbase = bitbases[ending];
+  std::call_once(bitbase.built, [&]() {
+    bitbase.wins =
+        ending == kKpk ? SolveKpk() : SolvePawnless(kEndingPieces[ending]);
+  });
+  return bitbase.wins;
+}
+
+int EdgeDistance(int square) {
+  return std::min({File(square), 7 - File(square), Rank(square),
+                   7 - Rank(square)});
+}
+
+// Bishop and knight only mate in a corner of the bishop's color.
+int CornerDistance(int square, int bishop) {
+  bool dark = (File(bishop) + Rank(bishop)) % 2 == 0;
+  return dark ? std::min(Distance(square, Square(0, 0)),
+                         Distance(square, Square(7, 7)))
+              : std::min(Distance(square, Square(7, 0)),
+                         Distance(square, Square(0, 7)));
+}
+
+}  // namespace
+
+void InitBitbases() {
+  std::vector<std::thread> threads;
+  for (int ending = 0; ending < kNumEndings; ++ending) {
+    threads.emplace_back([ending]() { Wins(static_cast<Ending>(ending)); });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+std::optional<Score> ProbeBitbases(const Board& board) {
+  struct Found {
+    PieceType type;
+    Color color;
+    int square;
+  };
+  Found found[4];
+  int count = 0;
+  int white = 0;
+  for (int x = 0; x < 8; ++x) {
+    for (int y = 0; y < 8; ++y) {
+      const Piece* piece = board.GetPiece(Position(x, y));
+      if (piece == nullptr) {
+        continue;
+      }
+      if (count == 4) {
+        return {};
+      }
+      found[count++] = {piece->Type(), piece->GetColor(), Square(x, y)};
+      white += piece->GetColor() == kWhite;
+    }
+  }
+  if (count < 3 || (white != 1 && white != count - 1)) {
+    return {};
+  }
+  Color strong = white == 1 ? kBlack : kWhite;
+  // Flipped so that the strong side plays up the board, as white.
+  auto flip = [&](int square) {
+    return strong == kWhite ? square : Square(File(square), 7 - Rank(square));
+  };
+  Setup setup = {};
+  setup.weak_to_move = board.CurrentPlayer() != strong;
+  PieceType types[kMaxPieces];
+  int num_pieces = 0;
+  for (int i = 0; i < count; ++i) {
+    int square = flip(found[i].square);
+    if (found[i].type != PieceType::kKing) {
+      setup.pieces[num_pieces] = square;
+      types[num_pieces++] = found[i].type;
+    } else if (found[i].color == strong) {
+      setup.king = square;
+    } else {
+      setup.weak_king = square;
+    }
+  }
+  if (num_pieces == 2 && types[0] == PieceType::kKnight) {
+    std::swap(types[0], types[1]);
+    std::swap(setup.pieces[0], setup.pieces[1]);
+  }
+  int ending = 0;
+  while (ending < kNumEndings &&
+         !std::equal(types, types + num_pieces, kEndingPieces[ending].begin(),
+                     kEndingPieces[ending].end())) {
+    ++ending;
+  }
+  if (ending == kNumEndings) {
+    return {};
+  }
+
+  bool won;
+  int progress;
+  if (ending == kKpk) {
+    int pawn = setup.pieces[0];
+    if (Rank(pawn) < 1 || Rank(pawn) > 6) {
+      return {};
+    }
+    bool mirror = File(pawn) > 3;
+    auto mirrored = [&](int square) {
+      return mirror ? Square(7 - File(square), Rank(square)) : square;
+    };
+    won = IsSet(Wins(kKpk),
+                KpkIndex(setup.weak_to_move, mirrored(setup.king),
+                         mirrored(setup.weak_king), mirrored(pawn)));
+    progress = 10 * (6 - Rank(pawn)) + Distance(setup.king, pawn);
+  } else {
+    progress = 4 * Distance(setup.king, setup.weak_king) +
+               10 * (ending == kKbnk
+                         ? CornerDistance(setup.weak_king, setup.pieces[0])
+                         : EdgeDistance(setup.weak_king));
+    Canonicalize(setup, num_pieces);
+    won = IsSet(Wins(static_cast<Ending>(ending)), Index(setup, num_pieces));
+  }
+  if (!won) {
+    return 0;
+  }
+  Score score = kTablebaseWin - progress;
+  return strong == kWhite ? score : -score;
+}
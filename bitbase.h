@@ -0,0 +1,20 @@
+#ifndef BITBASE_H_
+#define BITBASE_H_
+
+#include <optional>
+
+#include "board.h"
+#include "score.h"
+
+// Win/draw tables for king and pawn, rook, queen, or bishop and knight
+// against a bare king, one bit per position. They are built by retrograde
+// analysis the first time a position of their ending is probed, or all at
+// once, each on its own cores, by InitBitbases.
+void InitBitbases();
+
+// The score of `board` if it's one of the endings above: 0 if it's a draw,
+// otherwise kTablebaseWin for the winner, less how far the losing king still
+// is from where it gets mated, so that the search makes progress.
+std::optional<Score> ProbeBitbases(const Board& board);
+
+#endif  // BITBASE_H_
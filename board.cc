@@ -1,8 +1,12 @@
 #include "board.h"
 
 #include <algorithm>
+#include <charconv>
 #include <cstdlib>
 #include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
 #include <vector>
 #include <list>
 #include <unordered_map>
@@ -17,6 +21,7 @@
 #include "position.h"
 #include "queen.h"
 #include "rook.h"
+#include "trace.h"
 
 namespace {
 
@@ -38,47 +43,177 @@ void SetUpColor(Color color, int others, int pawns,
   }
 }
 
-std::vector<Move> GetMovesWithPossibleCheck(const Board& board, Color color) {
-  std::vector<Move> moves;
-  for (int x = 0; x <= 7; ++x) {
-    for (int y = 0; y <= 7; ++y) {
-      Position from(x, y);
-      auto piece = board.GetPiece(from);
-      if (!piece || piece->GetColor() != color) {
-        continue;
+std::unique_ptr<Piece>& GetMutablePiece(std::unique_ptr<Piece> (&board)[8][8],
+                                        Position position) {
+  return board[position.X()][position.Y()];
+}
+
+const std::string_view kFenLetters = "PNBRQKpnbrqk";
+
+char FenLetter(const Piece* piece) {
+  return kFenLetters[static_cast<int>(piece->Type()) +
+                     (piece->GetColor() == kWhite ? 0 : 6)];
+}
+
+// A FEN string split into its fields. Parsing it doesn't allocate.
+struct FenFields {
+  // By x and y like the board, the FEN letter or 0 for empty squares.
+  char squares[8][8] = {};
+  Color current_player = kWhite;
+  // By color, kingside then queenside.
+  bool castling[2][2] = {};
+  std::optional<Position> en_passant;
+  int halfmove_clock = 0;
+  int fullmove_number = 1;
+};
+
+// Removes the next space-separated field from `fen` and returns it, or an
+// empty view if there are no fields left.
+std::string_view NextField(std::string_view& fen) {
+  size_t start = fen.find_first_not_of(' ');
+  if (start == std::string_view::npos) {
+    fen = {};
+    return {};
+  }
+  fen.remove_prefix(start);
+  std::string_view field = fen.substr(0, fen.find(' '));
+  fen.remove_prefix(field.size());
+  return field;
+}
+
+bool ParsePlacement(std::string_view field, FenFields& fields) {
+  int x = 0;
+  int y = 7;
+  for (char c : field) {
+    if (c == '/') {
+      if (x != 8 || y == 0) {
+        return false;
       }
-      std::vector<Position> tos = piece->GetMoves(board, from);
-      bool is_pawn = dynamic_cast<const Pawn*>(piece) != nullptr;
-      for (const auto to : tos) {
-        if (is_pawn && (to.Y() == 0 || to.Y() == 7)) {
-          moves.emplace_back(from, to, kBishop);
-          moves.emplace_back(from, to, kKnight);
-          moves.emplace_back(from, to, kQueen);
-          moves.emplace_back(from, to, kRook);
-        } else {
-          moves.emplace_back(from, to, std::nullopt);
-        }
+      x = 0;
+      --y;
+    } else if (c >= '1' && c <= '8') {
+      x += c - '0';
+      if (x > 8) {
+        return false;
       }
+    } else if (x < 8 && c != '\0' &&
+               kFenLetters.find(c) != std::string_view::npos) {
+      fields.squares[x++][y] = c;
+    } else {
+      return false;
     }
   }
-  return moves;
+  return x == 8 && y == 0;
 }
 
-std::unique_ptr<Piece>& GetMutablePiece(std::unique_ptr<Piece> (&board)[8][8],
-                                        Position position) {
-  return board[position.X()][position.Y()];
+bool ParseCastling(std::string_view field, FenFields& fields) {
+  if (field == "-") {
+    return true;
+  }
+  for (char c : field) {
+    switch (c) {
+      case 'K':
+        fields.castling[kWhite][0] = true;
+        break;
+      case 'Q':
+        fields.castling[kWhite][1] = true;
+        break;
+      case 'k':
+        fields.castling[kBlack][0] = true;
+        break;
+      case 'q':
+        fields.castling[kBlack][1] = true;
+        break;
+      default:
+        return false;
+    }
+  }
+  return !field.empty();
+}
+
+// The square must be behind a pawn of the side that just moved.
+bool ParseEnPassant(std::string_view field, FenFields& fields) {
+  if (field == "-") {
+    return true;
+  }
+  char rank = fields.current_player == kWhite ? '6' : '3';
+  if (field.size() != 2 || field[0] < 'a' || field[0] > 'h' ||
+      field[1] != rank) {
+    return false;
+  }
+  fields.en_passant = Position(field[0] - 'a', rank - '1');
+  return true;
+}
+
+bool ParseNumber(std::string_view field, int minimum, int& number) {
+  auto [end, error] =
+      std::from_chars(field.data(), field.data() + field.size(), number);
+  return error == std::errc() && end == field.data() + field.size() &&
+         number >= minimum;
+}
+
+bool ParseFen(std::string_view fen, FenFields& fields) {
+  if (!ParsePlacement(NextField(fen), fields)) {
+    return false;
+  }
+  std::string_view side = NextField(fen);
+  if (side != "w" && side != "b") {
+    return false;
+  }
+  fields.current_player = side == "w" ? kWhite : kBlack;
+  if (!ParseCastling(NextField(fen), fields) ||
+      !ParseEnPassant(NextField(fen), fields)) {
+    return false;
+  }
+  std::string_view halfmove_clock = NextField(fen);
+  if (halfmove_clock.empty()) {
+    return true;
+  }
+  return ParseNumber(halfmove_clock, 0, fields.halfmove_clock) &&
+         ParseNumber(NextField(fen), 1, fields.fullmove_number) &&
+         NextField(fen).empty();
+}
+
+// Kings and rooks keep their castling rights by not having moved.
+std::unique_ptr<Piece> MakePiece(const FenFields& fields, int x, int y) {
+  char letter = fields.squares[x][y];
+  Color color = letter >= 'a' ? kBlack : kWhite;
+  const bool* rights = fields.castling[color];
+  bool king_home = fields.squares[4][y] == (color == kWhite ? 'K' : 'k') &&
+                   y == (color == kWhite ? 0 : 7);
+  switch (letter >= 'a' ? letter - 'a' + 'A' : letter) {
+    case 'P':
+      return std::make_unique<Pawn>(color);
+    case 'N':
+      return std::make_unique<Knight>(color);
+    case 'B':
+      return std::make_unique<Bishop>(color);
+    case 'R':
+      return std::make_unique<Rook>(
+          color, !king_home || !((x == 7 && rights[0]) || (x == 0 && rights[1])));
+    case 'Q':
+      return std::make_unique<Queen>(color);
+    default:
+      return std::make_unique<King>(
+          color, !(king_home && x == 4 && (rights[0] || rights[1])));
+  }
 }
 
 }  // namespace
 
-Board::Board() : current_player_(kWhite), turn_(0), cached_turn_(-1) {
+Board::Board() : Board(kWhite) {
   SetUpColor(kWhite, 0, 1, board_);
   SetUpColor(kBlack, 7, 6, board_);
   ++repetitions_[Hash()];
 }
 
-// The cache is not copied because it's probably irrelevant anyway
-Board::Board(const Board& b) : current_player_(b.current_player_), turn_(b.turn_), cached_turn_(-1), repetitions_(b.repetitions_) {
+Board::Board(Color current_player)
+    : current_player_(current_player),
+      halfmove_clock_(0),
+      fullmove_number_(1),
+      resets_clock_(false) {}
+
+Board::Board(const Board& b) : current_player_(b.current_player_), en_passant_(b.en_passant_), halfmove_clock_(b.halfmove_clock_), fullmove_number_(b.fullmove_number_), resets_clock_(b.resets_clock_), legal_moves_(b.legal_moves_), repetitions_(b.repetitions_) {
   for (int i = 0; i < 8; ++i) {
     for (int j = 0; j < 8; ++j) {
       if (b.board_[i][j] != nullptr) {
@@ -90,7 +225,7 @@ Board::Board(const Board& b) : current_player_(b.current_player_), turn_(b.turn_
   }
 }
 
-Board::Board(std::vector<std::tuple<Position, std::unique_ptr<Piece>>>& positions, Color current_player) : current_player_(current_player), turn_(0), cached_turn_(-1) {
+Board::Board(std::vector<std::tuple<Position, std::unique_ptr<Piece>>>& positions, Color current_player) : Board(current_player) {
   for (auto item = positions.begin(); item != positions.end(); ++item) {
     Position& pos = std::get<0>(*item);
     board_[pos.X()][pos.Y()] = std::move(std::get<1>(*item));
@@ -98,6 +233,94 @@ Board::Board(std::vector<std::tuple<Position, std::unique_ptr<Piece>>>& position
   ++repetitions_[Hash()];
 }
 
+std::optional<Board> Board::FromFen(std::string_view fen) {
+  FenFields fields;
+  if (!ParseFen(fen, fields)) {
+    return {};
+  }
+  Board board(fields.current_player);
+  int kings[2] = {0, 0};
+  for (int x = 0; x <= 7; ++x) {
+    for (int y = 0; y <= 7; ++y) {
+      if (fields.squares[x][y] == 0) {
+        continue;
+      }
+      auto piece = MakePiece(fields, x, y);
+      if (piece->Type() == PieceType::kPawn && (y == 0 || y == 7)) {
+        return {};
+      }
+      if (piece->Type() == PieceType::kKing) {
+        ++kings[piece->GetColor()];
+      }
+      board.board_[x][y] = std::move(piece);
+    }
+  }
+  if (kings[kWhite] != 1 || kings[kBlack] != 1 ||
+      board.IsCheck(Other(fields.current_player))) {
+    return {};
+  }
+  board.en_passant_ = fields.en_passant;
+  board.halfmove_clock_ = fields.halfmove_clock;
+  board.fullmove_number_ = fields.fullmove_number;
+  ++board.repetitions_[board.Hash()];
+  return board;
+}
+
+std::string Board::ToFen() const {
+  std::string fen;
+  fen.reserve(90);
+  for (int y = 7; y >= 0; --y) {
+    int empty = 0;
+    for (int x = 0; x <= 7; ++x) {
+      const Piece* piece = board_[x][y].get();
+      if (piece == nullptr) {
+        ++empty;
+        continue;
+      }
+      if (empty > 0) {
+        fen += '0' + empty;
+        empty = 0;
+      }
+      fen += FenLetter(piece);
+    }
+    if (empty > 0) {
+      fen += '0' + empty;
+    }
+    fen += y > 0 ? '/' : ' ';
+  }
+  fen += current_player_ == kWhite ? "w " : "b ";
+
+  size_t castling = fen.size();
+  for (Color color : {kWhite, kBlack}) {
+    int y = color == kWhite ? 0 : 7;
+    const Piece* king = board_[4][y].get();
+    if (king == nullptr || king->Type() != PieceType::kKing ||
+        king->GetColor() != color ||
+        static_cast<const King*>(king)->Moved()) {
+      continue;
+    }
+    for (int x : {7, 0}) {
+      const Piece* rook = board_[x][y].get();
+      if (rook != nullptr && rook->Type() == PieceType::kRook &&
+          rook->GetColor() == color &&
+          !static_cast<const Rook*>(rook)->Moved()) {
+        fen += kFenLetters[(x == 7 ? 5 : 4) + (color == kWhite ? 0 : 6)];
+      }
+    }
+  }
+  if (fen.size() == castling) {
+    fen += '-';
+  }
+
+  fen += ' ';
+  fen += en_passant_.has_value() ? en_passant_->String() : "-";
+  fen += ' ';
+  fen += std::to_string(halfmove_clock_);
+  fen += ' ';
+  fen += std::to_string(fullmove_number_);
+  return fen;
+}
+
 void Board::Print(std::ostream& out) const {
   for (int y = 7; y >= 0; --y) {
     out << y + 1 << " ";
@@ -112,39 +335,78 @@ void Board::Print(std::ostream& out) const {
   out << "  abcdefgh" << std::endl;
 }
 
-int Board::CountTargetedSquares(Color color) {
+LegalMovesMemo::LegalMovesMemo(LegalMovesMemo&& other) noexcept {
+  *this = std::move(other);
+}
+
+LegalMovesMemo& LegalMovesMemo::operator=(LegalMovesMemo&& other) noexcept {
+  moves_ = std::move(other.moves_);
+  state_.store(other.state_.load(std::memory_order_acquire) == kKept ? kKept
+                                                                      : kEmpty,
+               std::memory_order_relaxed);
+  other.Clear();
+  return *this;
+}
+
+void LegalMovesMemo::Clear() {
+  state_.store(kEmpty, std::memory_order_relaxed);
+  moves_.clear();
+}
+
+int Board::CountTargetedSquares(Color color) const {
   return (int) GetMovesInternal(color).size();
 }
 
-std::vector<Move> Board::GetMoves() {
-  if (cached_turn_ != turn_) {
-    cached_turn_ = turn_;
-    cached_moves_ = GetMovesInternal(current_player_);
-  }
-  return cached_moves_;
+std::vector<Move> Board::GetMoves() const {
+  return legal_moves_.Get(
+      [this]() { return GetMovesInternal(current_player_); });
 }
 
-std::vector<Move> Board::GetMovesInternal(Color color) {
-  std::vector<Move> moves = GetMovesWithPossibleCheck(*this, color);
-  for (auto i = moves.begin(); i != moves.end();) {
-    std::unique_ptr<Piece>& from = GetMutablePiece(board_, i->From());
-    std::unique_ptr<Piece>& to = GetMutablePiece(board_, i->To());
-    std::unique_ptr<Piece> to_copy = std::move(to);
-    to = std::move(from);
-    bool is_check = IsCheck(color);
-    from = std::move(to);
-    to = std::move(to_copy);
-    if (is_check) {
-      i = moves.erase(i);
-      continue;
-    }
-    ++i;
+std::vector<Move> Board::GetMovesInternal(Color color) const {
+  TRACE_SCOPE("movegen", color);
+  std::vector<Move> moves;
+  if (color == kWhite) {
+    GenerateLegalMoves<kWhite, kAllMoves>(*this, moves);
+  } else {
+    GenerateLegalMoves<kBlack, kAllMoves>(*this, moves);
   }
   return moves;
 }
 
-GameOutcome Board::GetGameOutcome() {
-  if (repetitions_[Hash()] >= 3) {
+namespace {
+
+template <Color Us>
+void GenerateMovesFor(const Board& board, MoveGenMode mode,
+                      std::vector<Move>& moves) {
+  switch (mode) {
+    case kAllMoves:
+      GenerateLegalMoves<Us, kAllMoves>(board, moves);
+      break;
+    case kCaptureMoves:
+      GenerateLegalMoves<Us, kCaptureMoves>(board, moves);
+      break;
+    case kQuietMoves:
+      GenerateLegalMoves<Us, kQuietMoves>(board, moves);
+      break;
+    case kEvasionMoves:
+      GenerateLegalMoves<Us, kEvasionMoves>(board, moves);
+      break;
+  }
+}
+
+}  // namespace
+
+void Board::GenerateMoves(MoveGenMode mode, std::vector<Move>& moves) const {
+  TRACE_SCOPE("movegen", mode);
+  if (current_player_ == kWhite) {
+    GenerateMovesFor<kWhite>(*this, mode, moves);
+  } else {
+    GenerateMovesFor<kBlack>(*this, mode, moves);
+  }
+}
+
+GameOutcome Board::GetGameOutcome() const {
+  if (IsRepetition()) {
     return kDraw;
   }
   std::vector<Move> moves = GetMoves();
@@ -164,8 +426,9 @@ const Piece* Board::GetPiece(Position position) const {
 std::optional<Position> Board::FindKing(Color color) const {
   for (int i = 0; i < 8; ++i) {
     for (int j = 0; j <  8; ++j) {
-      const King* king = dynamic_cast<const King*>(board_[i][j].get());
-      if (king && king->GetColor() == color) {
+      const Piece* piece = board_[i][j].get();
+      if (piece && piece->Type() == PieceType::kKing &&
+          piece->GetColor() == color) {
         return Position(i, j);
       }
     }
@@ -174,73 +437,34 @@ std::optional<Position> Board::FindKing(Color color) const {
 }
 
 bool Board::IsCheck(Color color) const {
-  auto kingpos = FindKing(color);
-  if (!kingpos.has_value()) {
-    return false;
-  }
-  Bishop bishop(color);
-  for (auto pos : bishop.GetMoves(*this, kingpos.value())) {
-    const Piece *p = this->GetPiece(pos);
-    if (dynamic_cast<const Bishop*>(p) != nullptr) {
-      return true;
-    } else if (dynamic_cast<const Queen*>(p) != nullptr) {
-      return true;
-    }
-  }
-  Rook rook(color);
-  for (auto pos : rook.GetMoves(*this, kingpos.value())) {
-    const Piece *p = this->GetPiece(pos);
-    if (dynamic_cast<const Rook*>(p) != nullptr) {
-      return true;
-    } else if (dynamic_cast<const Queen*>(p) != nullptr) {
-      return true;
-    }
-  }
-  Knight knight(color);
-  for (auto pos : knight.GetMoves(*this, kingpos.value())) {
-    const Piece *p = this->GetPiece(pos);
-    if (dynamic_cast<const Knight*>(p) != nullptr) {
-      return true;
-    }
-  }
-  std::vector<Position> pawns;
-  if (color == kWhite) {
-    int x, y;
-    x = kingpos.value().X() + 1;
-    y = kingpos.value().Y() + 1;
-    if (x < 8 && y < 8) {
-      pawns.emplace_back(x, y);
-    }
-    x = kingpos.value().X() - 1;
-    y = kingpos.value().Y() + 1;
-    if (x >= 0 && y < 8) {
-      pawns.emplace_back(x, y);
-    }
-  } else {
-    int x, y;
-    x = kingpos.value().X() + 1;
-    y = kingpos.value().Y() - 1;
-    if (x < 8 && y >= 0) {
-      pawns.emplace_back(x, y);
-    }
-    x = kingpos.value().X() - 1;
-    y = kingpos.value().Y() - 1;
-    if (x >= 0 && y >= 0) {
-      pawns.emplace_back(x, y);
-    }
-  }
-  for (auto pos : pawns) {
-    const Piece *p = this->GetPiece(pos);
-    if (dynamic_cast<const Pawn*>(p) != nullptr && p->GetColor() == Other(color)) {
-      return true;
-    }
+  return color == kWhite ? IsInCheck<kWhite>(*this) : IsInCheck<kBlack>(*this);
+}
+
+bool Board::IsLegalMove(const Move& move) const {
+  if (current_player_ == kWhite) {
+    return IsPseudoLegal<kWhite>(*this, move) && IsLegal<kWhite>(*this, move);
   }
-  return false;
+  return IsPseudoLegal<kBlack>(*this, move) && IsLegal<kBlack>(*this, move);
+}
+
+bool Board::IsRepetition() const {
+  auto repetitions = repetitions_.find(Hash());
+  return repetitions != repetitions_.end() && repetitions->second >= 3;
 }
 
 void Board::DoMove(const Move& move) {
+  TRACE_SCOPE("make", move.Pack());
+  legal_moves_.Clear();
   std::unique_ptr<Piece>& from = GetMutablePiece(board_, move.From());
   std::unique_ptr<Piece>& to = GetMutablePiece(board_, move.To());
+  bool pawn = from->Type() == PieceType::kPawn;
+  if (pawn || to != nullptr) {
+    resets_clock_ = true;
+  }
+  en_passant_.reset();
+  if (pawn && std::abs(move.To().Y() - move.From().Y()) == 2) {
+    en_passant_ = Position(move.From().X(), (move.From().Y() + move.To().Y()) / 2);
+  }
   to = std::move(from);
   from = nullptr;
   to->DoMove(*this, move);
@@ -255,12 +479,18 @@ void Board::NewTurn() {
       }
     }
   }
-  ++turn_;
+  halfmove_clock_ = resets_clock_ ? 0 : halfmove_clock_ + 1;
+  resets_clock_ = false;
+  if (current_player_ == kBlack) {
+    ++fullmove_number_;
+  }
+  legal_moves_.Clear();
   current_player_ = Other(current_player_);
   ++repetitions_[Hash()];
 }
 
 void Board::Set(Position position, std::unique_ptr<Piece> piece) {
+  legal_moves_.Clear();
   GetMutablePiece(board_, position) = std::move(piece);
 }
 
@@ -282,32 +512,17 @@ std::string Board::Hash() const {
   hash.reserve(128);
   for (int i = 0; i < 8; ++i) {
     for (int j = 0; j < 8; ++j) {
-      const Pawn *p;
-      const King *k;
-      const Rook *r;
-      const Knight *n;
-      const Bishop *b;
-      const Queen *q;
-      if ((p = dynamic_cast<const Pawn*>(board_[i][j].get())) != nullptr) {
-        hash += p->GetColor() == kWhite ? "P" : "p";
-      } else if ((n = dynamic_cast<const Knight*>(board_[i][j].get())) != nullptr) {
-        hash += n->GetColor() == kWhite ? "N" : "n";
-      } else if ((b = dynamic_cast<const Bishop*>(board_[i][j].get())) != nullptr) {
-        hash += b->GetColor() == kWhite ? "B" : "b";
-      } else if ((r = dynamic_cast<const Rook*>(board_[i][j].get())) != nullptr) {
-        hash += r->GetColor() == kWhite ? "R" : "r";
-        if (!r->Moved()) {
-          hash += "'";
-        }
-      } else if ((q = dynamic_cast<const Queen*>(board_[i][j].get())) != nullptr) {
-        hash += q->GetColor() == kWhite ? "Q" : "q";
-      } else if ((k = dynamic_cast<const King*>(board_[i][j].get())) != nullptr) {
-        hash += k->GetColor() == kWhite ? "K" : "k";
-        if (!k->Moved()) {
-          hash += "'";
-        }
-      } else {
+      const Piece* piece = board_[i][j].get();
+      if (piece == nullptr) {
         hash += ".";
+        continue;
+      }
+      hash += FenLetter(piece);
+      if ((piece->Type() == PieceType::kRook &&
+           !static_cast<const Rook*>(piece)->Moved()) ||
+          (piece->Type() == PieceType::kKing &&
+           !static_cast<const King*>(piece)->Moved())) {
+        hash += "'";
       }
     }
   }
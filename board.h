@@ -1,49 +1,107 @@
 #ifndef BOARD_H_
 #define BOARD_H_
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <vector>
 #include <list>
 #include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
 #include <unordered_map>
 
 #include "color.h"
 #include "move.h"
+#include "movegen.h"
 #include "piece.h"
 #include "position.h"
 
 enum GameOutcome { kInProgress, kDraw, kCheckmate };
 
+// The legal moves of a position, generated by the first query that needs
+// them. Readers on several threads may each generate them, and the first to
+// finish keeps them for later queries; none waits for another. Copies start
+// out empty, since the copy of a board is usually about to change.
+class LegalMovesMemo {
+ public:
+  LegalMovesMemo() = default;
+  LegalMovesMemo(const LegalMovesMemo&) {}
+  LegalMovesMemo(LegalMovesMemo&& other) noexcept;
+  LegalMovesMemo& operator=(LegalMovesMemo&& other) noexcept;
+
+  template <typename Generate>
+  std::vector<Move> Get(Generate generate) const {
+    if (state_.load(std::memory_order_acquire) == kKept) {
+      return moves_;
+    }
+    std::vector<Move> moves = generate();
+    uint8_t empty = kEmpty;
+    if (state_.compare_exchange_strong(empty, kKeeping,
+                                       std::memory_order_acquire)) {
+      moves_ = moves;
+      state_.store(kKept, std::memory_order_release);
+    }
+    return moves;
+  }
+  // Only while no one reads the board.
+  void Clear();
+
+ private:
+  enum : uint8_t { kEmpty, kKeeping, kKept };
+
+  mutable std::atomic<uint8_t> state_ = kEmpty;
+  mutable std::vector<Move> moves_;
+};
+
 class Board {
  public:
   Board();
   Board(const Board& b);
+  Board(Board&& b) = default;
+  Board& operator=(Board&& b) = default;
   Board(std::vector<std::tuple<Position, std::unique_ptr<Piece>>>& positions, Color current_player);
+  // Returns nullopt if `fen` isn't a legal position in Forsyth-Edwards
+  // Notation. The move clocks may be left out, as in EPD. Castling rights
+  // without the king and rook on their squares are dropped. The en passant
+  // square is only kept for ToFen, en passant captures aren't generated.
+  static std::optional<Board> FromFen(std::string_view fen);
+  std::string ToFen() const;
   void Print(std::ostream& out = std::cout) const;
-  std::vector<Move> GetMoves();
-  int CountTargetedSquares(Color color);
+  // Queries are const and leave the board alone, so that threads can share
+  // one without copying it, as long as none changes it meanwhile.
+  std::vector<Move> GetMoves() const;
+  void GenerateMoves(MoveGenMode mode, std::vector<Move>& moves) const;
+  int CountTargetedSquares(Color color) const;
   const Piece* GetPiece(Position position) const;
   std::list<const Piece*> GetPieces() const;
   bool IsCheck(Color color) const;
+  bool IsLegalMove(const Move& move) const;
+  bool IsRepetition() const;
   void DoMove(const Move& move);
   void NewTurn();
   void Set(Position position, std::unique_ptr<Piece> piece);
   std::optional<Position> FindKing(Color color) const;
   std::string Hash() const;
-  GameOutcome GetGameOutcome();
+  GameOutcome GetGameOutcome() const;
   Color CurrentPlayer() const;
 
  private:
-  std::vector<Move> GetMovesInternal(Color color);
+  explicit Board(Color current_player);
+  std::vector<Move> GetMovesInternal(Color color) const;
   void DoMoveInternal(const Move& move);
 
   std::unique_ptr<Piece> board_[8][8];
   Color current_player_;
 
-  int turn_;
+  std::optional<Position> en_passant_;
+  int halfmove_clock_;
+  int fullmove_number_;
+  // Whether the move being played is a capture or a pawn move.
+  bool resets_clock_;
 
-  std::vector<Move> cached_moves_;
-  int cached_turn_;
+  LegalMovesMemo legal_moves_;
 
   std::unordered_map<std::string, int> repetitions_;
 };
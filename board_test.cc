@@ -1,10 +1,15 @@
 #define BOOST_TEST_MODULE board tests
 #include <boost/test/included/unit_test.hpp>
 
+#include "bench.h"
 #include "king.h"
 #include "rook.h"
 #include "board.h"
 #include "move.h"
+#include "movepicker.h"
+#include "pawn.h"
+#include "queen.h"
+#include "see.h"
 
 BOOST_AUTO_TEST_CASE(TestCastleKeepsTurn) {
   std::vector<std::tuple<Position, std::unique_ptr<Piece>>> positions;
@@ -18,4 +23,103 @@ BOOST_AUTO_TEST_CASE(TestCastleKeepsTurn) {
   b.NewTurn();
 
   BOOST_CHECK_EQUAL(b.CurrentPlayer(), kBlack);
-}
\ No newline at end of file
+}
+BOOST_AUTO_TEST_CASE(TestPerftFromStartingPosition) {
+  Board b;
+  BOOST_CHECK_EQUAL(Perft(b, 1), 20);
+  BOOST_CHECK_EQUAL(Perft(b, 2), 400);
+  BOOST_CHECK_EQUAL(Perft(b, 3), 8902);
+}
+
+BOOST_AUTO_TEST_CASE(TestFenRoundTrip) {
+  const std::string start =
+      "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+  Board b;
+  BOOST_CHECK_EQUAL(b.ToFen(), start);
+  BOOST_CHECK_EQUAL(Board::FromFen(start)->Hash(), b.Hash());
+
+  b.DoMove(Move::FromXboardString("e2e4").value());
+  b.NewTurn();
+  b.DoMove(Move::FromXboardString("g8f6").value());
+  b.NewTurn();
+  b.DoMove(Move::FromXboardString("e1e2").value());
+  b.NewTurn();
+  BOOST_CHECK_EQUAL(
+      b.ToFen(), "rnbqkb1r/pppppppp/5n2/8/4P3/8/PPPPKPPP/RNBQ1BNR b kq - 2 2");
+
+  for (std::string fen :
+       {"rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1",
+        "r3k2r/8/8/8/8/8/8/R3K2R w Kq - 12 40",
+        "8/8/8/4k3/8/8/8/4K3 b - - 99 120"}) {
+    auto board = Board::FromFen(fen);
+    BOOST_REQUIRE(board.has_value());
+    BOOST_CHECK_EQUAL(board->ToFen(), fen);
+  }
+  // The clocks are optional.
+  BOOST_CHECK_EQUAL(Board::FromFen("8/8/8/4k3/8/8/8/4K3 w - -")->ToFen(),
+                    "8/8/8/4k3/8/8/8/4K3 w - - 0 1");
+}
+
+BOOST_AUTO_TEST_CASE(TestFenRejectsInvalidPositions) {
+  for (std::string fen :
+       {"", "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR",
+        "rnbqkbnr/pppppppp/9/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "rnbqkbnr/pppppppp/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR x KQkq - 0 1",
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkx - 0 1",
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq e3 0 1",
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 0",
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1 1",
+        "8/8/8/8/8/8/8/4K3 w - - 0 1", "P3k3/8/8/8/8/8/8/4K3 w - - 0 1",
+        "4k3/4R3/8/8/8/8/8/4K3 w - - 0 1"}) {
+    BOOST_CHECK_MESSAGE(!Board::FromFen(fen).has_value(), fen);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestMovePickerYieldsEveryMoveOnce) {
+  Board b;
+  b.DoMove(Move::FromXboardString("e2e4").value());
+  b.NewTurn();
+  b.DoMove(Move::FromXboardString("d7d5").value());
+  b.NewTurn();
+
+  auto cache_move = Move::FromXboardString("g1f3").value();
+  auto killer = Move::FromXboardString("b1c3").value();
+  MovePicker picker(b, cache_move.Pack(), {killer.Pack(), kNoMove});
+
+  std::vector<uint16_t> picked;
+  while (auto move = picker.Next()) {
+    picked.push_back(move->Pack());
+  }
+  std::vector<uint16_t> expected;
+  for (const Move& move : b.GetMoves()) {
+    expected.push_back(move.Pack());
+  }
+
+  BOOST_REQUIRE(!picked.empty());
+  BOOST_CHECK_EQUAL(picked[0], cache_move.Pack());
+  // the capture comes before the killer
+  BOOST_CHECK_EQUAL(picked[1], Move::FromXboardString("e4d5").value().Pack());
+  BOOST_CHECK_EQUAL(picked[2], killer.Pack());
+  std::sort(picked.begin(), picked.end());
+  std::sort(expected.begin(), expected.end());
+  BOOST_CHECK(picked == expected);
+}
+
+BOOST_AUTO_TEST_CASE(TestStaticExchange) {
+  std::vector<std::tuple<Position, std::unique_ptr<Piece>>> positions;
+  positions.emplace_back(Position(4, 0), std::make_unique<King>(kWhite));
+  positions.emplace_back(Position(3, 0), std::make_unique<Queen>(kWhite));
+  positions.emplace_back(Position(3, 1), std::make_unique<Rook>(kWhite));
+  positions.emplace_back(Position(3, 5), std::make_unique<Pawn>(kBlack));
+  positions.emplace_back(Position(4, 6), std::make_unique<Pawn>(kBlack));
+  positions.emplace_back(Position(7, 7), std::make_unique<King>(kBlack));
+  Board b(positions, kWhite);
+
+  // the rook is lost for two pawns: the queen behind it takes back
+  BOOST_CHECK_EQUAL(StaticExchange(b, *Move::FromXboardString("d2d6")), 1 - 5 + 1);
+
+  // once the pawn is undefended the capture simply wins it
+  b.Set(Position(4, 6), nullptr);
+  BOOST_CHECK_EQUAL(StaticExchange(b, *Move::FromXboardString("d2d6")), 1);
+}
@@ -0,0 +1,148 @@
+#include "cache.h"
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Transparent huge pages only back 2 MiB blocks that start on a 2 MiB
+// boundary.
+const size_t kHugePageSize = 2 << 20;
+// Not worth a thread for less.
+const size_t kMinClearSlice = 16 << 20;
+
+}  // namespace
+
+Cache::Cache(size_t megabytes) {
+  Allocate(megabytes);
+}
+
+Cache::~Cache() {
+  Free();
+}
+
+void Cache::Allocate(size_t megabytes) {
+  size_t bytes = std::max<size_t>(megabytes, 1) << 20;
+  size_t num_buckets = std::bit_floor(bytes / sizeof(Bucket));
+  size_t mapping_size = num_buckets * sizeof(Bucket) + kHugePageSize;
+  // Anonymous memory comes zeroed, so the table starts out empty.
+  void* mapping = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapping == MAP_FAILED) {
+    throw std::bad_alloc();
+  }
+  num_buckets_ = num_buckets;
+  mapping_ = mapping;
+  mapping_size_ = mapping_size;
+  auto address = reinterpret_cast<uintptr_t>(mapping_);
+  address = (address + kHugePageSize - 1) & ~(kHugePageSize - 1);
+  buckets_ = reinterpret_cast<Bucket*>(address);
+#ifdef MADV_HUGEPAGE
+  madvise(buckets_, num_buckets_ * sizeof(Bucket), MADV_HUGEPAGE);
+#endif
+}
+
+void Cache::Free() {
+  if (mapping_ != nullptr) {
+    munmap(mapping_, mapping_size_);
+    mapping_ = nullptr;
+  }
+}
+
+const CacheEntry* Cache::Find(size_t key) const {
+  const Bucket& bucket = buckets_[key & (num_buckets_ - 1)];
+  for (const Slot& slot : bucket.slots) {
+    if (slot.used && slot.key == key) {
+      return &slot.entry;
+    }
+  }
+  return nullptr;
+}
+
+void Cache::Store(size_t key, const CacheEntry& entry) {
+  Bucket& bucket = buckets_[key & (num_buckets_ - 1)];
+  // Older searches count a full search deeper than any depth.
+  auto worth = [&](const Slot& slot) {
+    uint8_t age = generation_ - slot.generation;
+    return slot.entry.depth - 256 * age;
+  };
+  Slot* replaced = &bucket.slots[0];
+  for (Slot& slot : bucket.slots) {
+    if (!slot.used || slot.key == key) {
+      replaced = &slot;
+      break;
+    }
+    if (worth(slot) < worth(*replaced)) {
+      replaced = &slot;
+    }
+  }
+  *replaced = {key, entry, generation_, 1};
+}
+
+void Cache::Resize(size_t megabytes) {
+  Bucket* buckets = buckets_;
+  size_t num_buckets = num_buckets_;
+  void* mapping = mapping_;
+  size_t mapping_size = mapping_size_;
+  Allocate(megabytes);
+  for (size_t i = 0; i < num_buckets; ++i) {
+    for (const Slot& slot : buckets[i].slots) {
+      if (slot.used) {
+        Store(slot.key, slot.entry);
+      }
+    }
+  }
+  munmap(mapping, mapping_size);
+}
+
+void Cache::Clear() {
+  size_t bytes = num_buckets_ * sizeof(Bucket);
+  size_t cores = std::max(1u, std::thread::hardware_concurrency());
+  size_t threads = std::clamp<size_t>(bytes / kMinClearSlice, 1, cores);
+  // Whole buckets per thread.
+  size_t slice = (num_buckets_ + threads - 1) / threads;
+  std::vector<std::thread> clearing;
+  for (size_t i = 0; i < threads; ++i) {
+    clearing.emplace_back([this, i, slice]() {
+      size_t begin = std::min(i * slice, num_buckets_);
+      size_t end = std::min(begin + slice, num_buckets_);
+      memset(static_cast<void*>(buckets_ + begin), 0,
+             (end - begin) * sizeof(Bucket));
+    });
+  }
+  for (std::thread& thread : clearing) {
+    thread.join();
+  }
+  generation_ = 0;
+}
+
+void Cache::NewGame() {
+  if (!keep_across_games_) {
+    Clear();
+  }
+}
+
+void Cache::KeepAcrossGames(bool keep) {
+  keep_across_games_ = keep;
+}
+
+void Cache::NewSearch() {
+  ++generation_;
+}
+
+size_t Cache::Size() const {
+  size_t size = 0;
+  ForEach([&](size_t, const CacheEntry&) { ++size; });
+  return size;
+}
+
+size_t Cache::Capacity() const {
+  return num_buckets_ * kSlotsPerBucket;
+}
@@ -1,10 +1,89 @@
 #ifndef CACHE_H_
 #define CACHE_H_
 
-#include <vector>
-#include <unordered_map>
-#include <string>
+#include <cstddef>
+#include <cstdint>
 
-typedef std::unordered_map<int, float> Cache;
+// The utility is relative to the cached position, see ScoreToCache, and only
+// valid for a search of exactly `depth` plies. The move is the best one found
+// and is worth trying first at any depth.
+struct CacheEntry {
+  int16_t utility;
+  int16_t depth;
+  uint16_t move;
+};
 
-#endif  // CACHE_H_
\ No newline at end of file
+const size_t kDefaultCacheMegabytes = 64;
+
+// The transposition table: one block of memory, aligned for huge pages and
+// split into buckets of a cache line each. A key only ever goes to one
+// bucket, so a probe touches a single line, which Prefetch can start loading
+// before the probe. A full bucket gives up the entry of the oldest search,
+// and of those the shallowest.
+class Cache {
+ public:
+  explicit Cache(size_t megabytes = kDefaultCacheMegabytes);
+  ~Cache();
+  Cache(const Cache&) = delete;
+  Cache& operator=(const Cache&) = delete;
+
+  // The entry for `key`, if the table still has it.
+  const CacheEntry* Find(size_t key) const;
+  void Store(size_t key, const CacheEntry& entry);
+  void Prefetch(size_t key) const {
+    __builtin_prefetch(&buckets_[key & (num_buckets_ - 1)]);
+  }
+
+  // Moves the entries to a table of `megabytes`, as many as fit.
+  void Resize(size_t megabytes);
+  // Empties the table, a slice per core.
+  void Clear();
+  // Clears the table, unless it's kept across games, as one loaded from a
+  // snapshot is.
+  void NewGame();
+  void KeepAcrossGames(bool keep);
+  // From now on, entries stored before are the first to be replaced.
+  void NewSearch();
+
+  // The entries stored. Counting them goes through the whole table.
+  size_t Size() const;
+  size_t Capacity() const;
+  // Calls `visit` with the key and the entry of each entry stored.
+  template <typename Visitor>
+  void ForEach(Visitor visit) const {
+    for (size_t i = 0; i < num_buckets_; ++i) {
+      for (const Slot& slot : buckets_[i].slots) {
+        if (slot.used) {
+          visit(static_cast<size_t>(slot.key), slot.entry);
+        }
+      }
+    }
+  }
+
+ private:
+  struct Slot {
+    uint64_t key;
+    CacheEntry entry;
+    // The search that stored it.
+    uint8_t generation;
+    uint8_t used;
+  };
+  static const int kSlotsPerBucket = 4;
+  struct alignas(64) Bucket {
+    Slot slots[kSlotsPerBucket];
+  };
+  static_assert(sizeof(Bucket) == 64);
+
+  void Allocate(size_t megabytes);
+  void Free();
+
+  Bucket* buckets_ = nullptr;
+  // A power of two, so that the low bits of a key pick its bucket.
+  size_t num_buckets_ = 0;
+  void* mapping_ = nullptr;
+  size_t mapping_size_ = 0;
+  uint8_t generation_ = 0;
+  bool keep_across_games_ = false;
+};
+
+#endif  // CACHE_H_
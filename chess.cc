@@ -1,21 +1,40 @@
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <cstdlib>
 #include <ctime>
 #include <chrono>
 #include <iostream>
 #include <fstream>
+#include <iomanip>
+#include <memory>
 #include <vector>
 #include <cstring>
+#include <optional>
 #include <set>
+#include <sstream>
+#include <thread>
 
+#include "allocs.h"
+#include "bench.h"
+#include "bitbase.h"
 #include "board.h"
 #include "position.h"
+#include "score.h"
 #include "color.h"
 #include "move.h"
 #include "engine.h"
+#include "epd.h"
+#include "input.h"
+#include "mate.h"
+#include "polyglot.h"
+#include "searcher.h"
+#include "snapshot.h"
+#include "tablebase.h"
+#include "trace.h"
+#include "uci.h"
 
 const int kDepth = 4;
-const auto kUtility = SmartUtility;
 
 Move ReadHumanMove(const std::vector<Move>& valid_moves) {
   while (true) {
@@ -39,28 +58,513 @@ Move ReadHumanMove(const std::vector<Move>& valid_moves) {
   }
 }
 
+// Scores from the engine's side as xboard wants them: centipawns, or 100000
+// plus the number of moves to mate.
+int XboardScore(Score score, Color color) {
+  int relative = color == kWhite ? score : -score;
+  if (!IsMateScore(score)) {
+    return relative;
+  }
+  int moves = (kMate - std::abs(score) + 1) / 2;
+  return relative > 0 ? 100000 + moves : -100000 - moves;
+}
+
+void PrintSearchStats(const SearchLimits& limits, double seconds,
+                      double branching_factor) {
+  const SearchStats& stats = limits.stats;
+  std::cout << std::fixed << std::setprecision(2) << "# Nodes: "
+            << limits.nodes << " (quiescence " << stats.quiescence_nodes
+            << "), nodes/s: "
+            << static_cast<uint64_t>(limits.nodes / std::max(seconds, 1e-9))
+            << ", cache hits: " << stats.cache_hits << "/"
+            << stats.cache_probes << ", cutoffs: " << stats.cutoffs
+            << " (first move "
+            << 100.0 * stats.first_move_cutoffs / std::max<uint64_t>(stats.cutoffs, 1)
+            << "%), branching factor: " << branching_factor
+            << ", selective depth: " << stats.selective_depth
+            << ", tablebase hits: " << stats.tablebase_hits << std::endl;
+  std::cout.unsetf(std::ios::fixed);
+}
+
+// Prints an xboard thinking line: the plies searched, the score, the time in
+// centiseconds, the nodes and the principal variation from `best`.
+void PrintThinking(const Board& board, const Move& best, int plies,
+                   Color color, double seconds, uint64_t nodes,
+                   const Cache& cache) {
+  std::ostringstream line;
+  line << plies << " " << XboardScore(best.Utility(), color) << " "
+       << static_cast<int>(seconds * 100) << " " << nodes;
+  for (const Move& move : PrincipalVariation(board, best, cache, plies)) {
+    line << " " << move.XboardString();
+  }
+  std::cout << line.str() << std::endl;
+}
+
+// Searches the position until `stop` is set, printing a thinking line after
+// every iteration and whenever the iteration under way finds a new best
+// move.
+void Analyze(Board& board, AnyUtility& utility, Cache& cache,
+             const Tablebases* tablebases, const std::atomic<bool>* stop) {
+  auto start = std::chrono::steady_clock::now();
+  Color color = board.CurrentPlayer();
+  SearchLimits limits;
+  limits.stop = stop;
+  limits.tablebases = tablebases;
+  int plies = 1;
+  std::string best;
+  auto seconds = [&]() {
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+  };
+  limits.new_best = [&](const Move& move) {
+    // The first move of an iteration only "beats" the ones before it if it
+    // isn't the best move of the last iteration.
+    if (move.XboardString() != best) {
+      best = move.XboardString();
+      PrintThinking(board, move, plies, color, seconds(), limits.nodes, cache);
+    }
+  };
+  auto report = [&](int depth, const std::vector<Move>& moves) {
+    best = moves.back().XboardString();
+    PrintThinking(board, moves.back(), depth + 1, color, seconds(),
+                  limits.nodes, cache);
+    plies = depth + 2;
+  };
+  SearchIteratively(board, color, kMaxDepth, utility, cache, limits, report);
+}
+
+// Plays from `book` if it has the position. Otherwise searches one ply deeper
+// at a time up to `depth`. With `post`, prints an xboard thinking line after
+// each iteration. When `stop` is set, returns the best move of the last
+// complete iteration.
 Move ChooseAiMove(
   Board& board,
   Color color,
   int depth,
-  double (*utility)(Board& board, Color attackingcolor),
-  Cache& cache
+  AnyUtility& utility,
+  Cache& cache,
+  PolyglotBook* book,
+  const Tablebases* tablebases,
+  bool post,
+  const std::atomic<bool>* stop = nullptr
 ) {
+  if (book != nullptr) {
+    if (auto move = book->Probe(board)) {
+      std::cout << "# Book move: " << move->XboardString() << std::endl;
+      return *move;
+    }
+  }
   auto t0 = std::chrono::high_resolution_clock::now();
-  auto valid_moves = ComputeUtility(board, color, depth, utility, cache);
+  SearchLimits limits;
+  limits.stop = stop;
+  limits.tablebases = tablebases;
+  uint64_t previous_nodes = 0;
+  uint64_t nodes_before = 0;
+  double branching_factor = 0;
+  auto report = [&](int iteration, const std::vector<Move>& moves) {
+    uint64_t nodes = limits.nodes - nodes_before;
+    nodes_before = limits.nodes;
+    if (previous_nodes > 0) {
+      branching_factor = static_cast<double>(nodes) / previous_nodes;
+    }
+    previous_nodes = nodes;
+    if (post) {
+      std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - t0;
+      PrintThinking(board, moves.back(), iteration + 1, color, elapsed.count(),
+                    limits.nodes, cache);
+    }
+  };
+  auto valid_moves = SearchIteratively(board, color, depth, utility, cache,
+                                       limits, report);
   std::chrono::duration<double, std::milli> delta = std::chrono::high_resolution_clock::now() - t0;
   std::cout << "# Move found in: " << (delta.count() / 1000.0) << "s" << std::endl;
-  std::sort(valid_moves.begin(), valid_moves.end(), ColorfulCompare(color));
+  PrintSearchStats(limits, delta.count() / 1000.0, branching_factor);
   for (Move move : valid_moves) {
     std::cout << "# " << move.From().String() << " " << move.To().String() << " " << move.Utility() << std::endl;
   }
   return valid_moves.back();
 }
 
+// The reply to `move` that the last search found best, if it's cached.
+std::optional<Move> ExpectedReply(const Board& board, const Move& move,
+                                  const Cache& cache) {
+  auto pv = PrincipalVariation(board, move, cache, 2);
+  if (pv.size() < 2) {
+    return {};
+  }
+  return pv[1];
+}
+
+// Speaks xboard to the GUI whose commands arrive on `queue`. Searches run on
+// their own thread, so "?" can make the engine move now, and any command that
+// changes the game stops them. Returns at "quit".
+void RunXboard(MessageQueue& queue, AnyUtility& utility, Cache& cache,
+               PolyglotBook* book, const Tablebases* tablebases) {
+  std::set<std::string> ignored = {
+    "random",
+    "level",
+    "time",
+    "otim",
+    "accepted",
+    "computer",
+    // Analysis status requests.
+    ".",
+  };
+  Board board;
+  // The positions before each move played, for "undo".
+  std::vector<Board> history;
+  Color mycolor = kBlack;
+  bool first_move = true;
+  bool post = false;
+  bool pondering = false;
+  bool analyzing = false;
+
+  // At most one search runs: for our move, for the position after the reply
+  // we expect, or to analyze the board. Results of any search but the latest
+  // are dropped.
+  enum Thinking { kIdle, kMoving, kPondering, kAnalyzing };
+  Thinking thinking = kIdle;
+  Searcher searcher;
+  int search = 0;
+  std::string expected_reply;
+  std::optional<Move> pondered;
+
+  auto start_search = [&](const Board& position) {
+    int id = ++search;
+    searcher.Start([&, position = Board(position), id, color = mycolor,
+                    post = post](const std::atomic<bool>* stop) mutable {
+      Move move = ChooseAiMove(position, color, kDepth, utility, cache, book,
+                               tablebases, post, stop);
+      queue.Push({Message::kSearchDone, "", id, move});
+    });
+  };
+  auto stop_search = [&]() {
+    ++search;
+    searcher.Stop();
+    thinking = kIdle;
+  };
+  auto think = [&]() {
+    thinking = kMoving;
+    start_search(board);
+  };
+  // Analysis restarts with every change to the board, with the cache it has
+  // warmed up so far.
+  auto analyze = [&]() {
+    stop_search();
+    if (!analyzing) {
+      return;
+    }
+    thinking = kAnalyzing;
+    searcher.Start([&, position = Board(board)](
+                       const std::atomic<bool>* stop) mutable {
+      Analyze(position, utility, cache, tablebases, stop);
+    });
+  };
+  auto make_move = [&](const Move& move) {
+    history.push_back(Board(board));
+    board.DoMove(move);
+    board.NewTurn();
+  };
+  // Plays our move, then ponders if we're allowed to and expect a reply.
+  auto play = [&](const Move& ai_move) {
+    auto reply = ExpectedReply(board, ai_move, cache);
+    make_move(ai_move);
+    std::cout << "move " << ai_move.XboardString() << std::endl;
+
+    auto valid_human_moves = board.GetMoves();
+    switch (board.GetGameOutcome()) {
+      case kCheckmate:
+        std::cout << "0-1 {Black mates}" << std::endl;
+        return;
+      case kDraw:
+        std::cout << "1/2-1/2 {draw}" << std::endl;
+        return;
+      case kInProgress:
+        break;
+    }
+    if (!pondering || !reply.has_value()) {
+      return;
+    }
+    Board position = board;
+    position.DoMove(*reply);
+    position.NewTurn();
+    if (position.GetGameOutcome() != kInProgress) {
+      return;
+    }
+    thinking = kPondering;
+    expected_reply = reply->XboardString();
+    pondered.reset();
+    start_search(position);
+  };
+
+  while (true) {
+    Message message = queue.Pop();
+    if (message.type == Message::kSearchDone) {
+      if (message.search != search) {
+        continue;
+      }
+      searcher.Wait();
+      if (thinking == kMoving) {
+        thinking = kIdle;
+        play(*message.move);
+      } else if (thinking == kPondering) {
+        // Kept until the opponent moves.
+        pondered = message.move;
+      }
+      continue;
+    }
+    const std::string& line = message.line;
+    std::string command = line.substr(0, line.find(" "));
+    if (command == "quit") {
+      stop_search();
+      return;
+    } else if (command == "protover") {
+      std::cout << "feature reuse=0 sigint=0 sigterm=0 setboard=1 analyze=1 memory=1" << std::endl;
+    } else if (command == "post") {
+      post = true;
+    } else if (command == "nopost") {
+      post = false;
+    } else if (command == "hard") {
+      pondering = true;
+    } else if (command == "easy") {
+      pondering = false;
+      if (thinking == kPondering) {
+        stop_search();
+      }
+    } else if (command == "analyze") {
+      analyzing = true;
+      analyze();
+    } else if (command == "exit") {
+      analyzing = false;
+      stop_search();
+    } else if (command == "undo") {
+      if (!history.empty()) {
+        stop_search();
+        board = std::move(history.back());
+        history.pop_back();
+        analyze();
+      }
+    } else if (command == "?") {
+      if (thinking == kMoving) {
+        searcher.RequestStop();
+      }
+    } else if (command == "new") {
+      stop_search();
+      cache.NewGame();
+    } else if (command == "force") {
+      stop_search();
+    } else if (command == "memory") {
+      // The table gets all of it, the rest is small.
+      stop_search();
+      cache.Resize(std::max(atoi(line.c_str() + command.size()), 1));
+    } else if (command == "white") {
+      stop_search();
+      mycolor = kWhite;
+    } else if (command == "black") {
+      stop_search();
+      mycolor = kBlack;
+    } else if (command == "setboard") {
+      stop_search();
+      auto fen_board = Board::FromFen(line.substr(command.size()));
+      if (!fen_board.has_value()) {
+        std::cout << "tellusererror Illegal position" << std::endl;
+        continue;
+      }
+      board = std::move(*fen_board);
+      history.clear();
+      analyze();
+    } else if (command == "go" && first_move) {
+      stop_search();
+      think();
+    } else if (ignored.find(command) != ignored.end()) {
+      // ignore
+    } else {
+      // not a known command, must be a move
+      first_move = false;
+      auto human_move = Move::FromXboardString(command);
+      if (!human_move.has_value()) {
+        std::cout << "Ilegal move: " << command << std::endl;
+        continue;
+      }
+      if (analyzing) {
+        make_move(*human_move);
+        analyze();
+        continue;
+      }
+      // On a ponder hit the search goes on, now on our time.
+      bool ponder_hit = thinking == kPondering && expected_reply == command;
+      if (!ponder_hit) {
+        stop_search();
+      }
+      make_move(*human_move);
+
+      auto valid_ai_moves = board.GetMoves();
+      switch (board.GetGameOutcome()) {
+        case kCheckmate:
+          std::cout << "1-0 {White mates}" << std::endl;
+          continue;
+        case kDraw:
+          std::cout << "1/2-1/2 {draw}" << std::endl;
+          continue;
+        case kInProgress:
+          break;
+      }
+
+      if (!ponder_hit) {
+        think();
+      } else if (pondered.has_value()) {
+        thinking = kIdle;
+        play(*pondered);
+      } else {
+        thinking = kMoving;
+      }
+    }
+  }
+}
+
 int main(int argc, char *argv[]) {
   Cache cache;
+  AnyUtility utility = SmartUtility();
+  bool ascii = false;
+  std::optional<int> bench_depth;
+  std::optional<int> perft_depth;
+  std::optional<int> mate_moves;
+  bool alloc_sites = false;
+  std::string epd;
+  std::string book_path;
+  std::string syzygy_path;
+  std::string cache_path;
+  BookSelection book_selection = BookSelection::kWeighted;
+  EpdOptions epd_options;
+  epd_options.threads = std::max(1u, std::thread::hardware_concurrency());
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "ascii")) {
+      ascii = true;
+    } else if (!strcmp(argv[i], "bench")) {
+      bench_depth = kBenchDepth;
+      if (i + 1 < argc && isdigit(argv[i + 1][0])) {
+        bench_depth = atoi(argv[++i]);
+      }
+    } else if (!strcmp(argv[i], "perft")) {
+      perft_depth = kPerftDepth;
+      if (i + 1 < argc && isdigit(argv[i + 1][0])) {
+        perft_depth = atoi(argv[++i]);
+      }
+    } else if (!strcmp(argv[i], "mate")) {
+      mate_moves = kMateMoves;
+      if (i + 1 < argc && isdigit(argv[i + 1][0])) {
+        mate_moves = atoi(argv[++i]);
+      }
+    } else if (!strcmp(argv[i], "allocs")) {
+      alloc_sites = true;
+    } else if (!strcmp(argv[i], "batch")) {
+      utility = BatchUtility();
+    } else if (!strncmp(argv[i], "nnue=", 5)) {
+      auto network = LoadNnueNetwork(argv[i] + 5);
+      if (!network) {
+        std::cerr << "Could not load network " << argv[i] + 5 << std::endl;
+        return 1;
+      }
+      utility = NnueUtility(network);
+    } else if (!strncmp(argv[i], "epd=", 4)) {
+      epd = argv[i] + 4;
+    } else if (!strncmp(argv[i], "nodes=", 6)) {
+      epd_options.max_nodes = strtoull(argv[i] + 6, nullptr, 10);
+    } else if (!strncmp(argv[i], "time=", 5)) {
+      epd_options.move_time = std::chrono::milliseconds(atoi(argv[i] + 5));
+    } else if (!strncmp(argv[i], "threads=", 8)) {
+      epd_options.threads = atoi(argv[i] + 8);
+    } else if (!strncmp(argv[i], "book=", 5)) {
+      book_path = argv[i] + 5;
+    } else if (!strncmp(argv[i], "syzygy=", 7)) {
+      syzygy_path = argv[i] + 7;
+    } else if (!strncmp(argv[i], "cachefile=", 10)) {
+      cache_path = argv[i] + 10;
+    } else if (!strcmp(argv[i], "bookbest")) {
+      book_selection = BookSelection::kBestWeight;
+    } else if (!strncmp(argv[i], "trace=", 6)) {
+#ifdef CHESS_TRACE
+      WriteTraceAtExit(argv[i] + 6);
+#else
+      std::cerr << "Tracing is compiled out, configure with -DCHESS_TRACE=ON"
+                << std::endl;
+#endif
+    }
+  }
+
+  if (bench_depth.has_value()) {
+    TrackAllocationSites(alloc_sites);
+    RunBench(*bench_depth, utility);
+    if (alloc_sites) {
+      std::cout << "Top allocation sites:" << std::endl;
+      PrintAllocationSites(20, std::cout);
+    }
+    return 0;
+  }
+
+  if (perft_depth.has_value()) {
+    RunPerft(*perft_depth);
+    return 0;
+  }
+
+  if (mate_moves.has_value()) {
+    RunMate(*mate_moves, epd_options.max_nodes, epd_options.move_time);
+    return 0;
+  }
 
-  if (argc > 1 && !strcmp(argv[1], "ascii")) {
+  if (!epd.empty()) {
+    if (epd_options.max_nodes == 0 && epd_options.move_time.count() <= 0) {
+      std::cerr << "Set nodes=<n> or time=<milliseconds>" << std::endl;
+      return 1;
+    }
+    if (!RunEpd(epd, epd_options, utility)) {
+      std::cerr << "Could not read " << epd << std::endl;
+      return 1;
+    }
+    return 0;
+  }
+
+  std::unique_ptr<PolyglotBook> book;
+  if (!book_path.empty()) {
+    const PolyglotRandoms* randoms = PolyglotRandomTable();
+    if (randoms == nullptr) {
+      std::cerr << "Built without polyglot_random.inc, can't read books"
+                << std::endl;
+      return 1;
+    }
+    book = PolyglotBook::Open(book_path, *randoms, book_selection);
+    if (!book) {
+      std::cerr << "Could not open book " << book_path << std::endl;
+      return 1;
+    }
+  }
+
+  std::unique_ptr<Tablebases> tablebases;
+  if (!syzygy_path.empty()) {
+    tablebases = Tablebases::Open(syzygy_path);
+    std::cerr << "Found " << tablebases->NumTables()
+              << " tablebases, up to " << tablebases->Cardinality()
+              << " pieces" << std::endl;
+  }
+
+  // Built now rather than in the middle of a timed search.
+  InitBitbases();
+
+  // Snapshots only mix scores of the same evaluator.
+  uint32_t evaluator = utility.index();
+  if (!cache_path.empty()) {
+    cache.KeepAcrossGames(true);
+    if (auto snapshot = LoadCacheSnapshot(cache_path, evaluator, cache)) {
+      std::cerr << "Loaded " << snapshot->entries << " cache entries"
+                << (snapshot->stale ? ", moves only, from another evaluator"
+                                    : "")
+                << std::endl;
+    }
+  }
+
+  if (ascii) {
     srand(unsigned(time(nullptr)));
     Board board;
     while (true) {
@@ -91,96 +595,28 @@ int main(int argc, char *argv[]) {
         case kInProgress:
           break;
       }
-      Move ai_move = ChooseAiMove(board, kBlack, kDepth, kUtility, cache);
+      Move ai_move = ChooseAiMove(board, kBlack, kDepth, utility, cache,
+                                  book.get(), tablebases.get(), false);
       std::cout << "AI played: " << ai_move.String() << std::endl;
       board.DoMove(ai_move);
       board.NewTurn();
     }
   } else {
     std::cout.setf(std::ios::unitbuf);
-    std::string line;
-    std::getline(std::cin, line);
-    if (line != "xboard") {
+    MessageQueue queue;
+    StartReadingInput(queue);
+    std::string protocol = queue.Pop().line;
+    if (protocol == "xboard") {
+      RunXboard(queue, utility, cache, book.get(), tablebases.get());
+    } else if (protocol == "uci") {
+      RunUci(queue, utility, cache, book.get(), tablebases.get());
+    } else {
       return 1;
     }
-    std::set<std::string> ignored = {
-      "new",
-      "random",
-      "level",
-      "post"
-      "hard",
-      "time",
-      "otim",
-      "post",
-      "hard",
-      "accepted",
-      "force",
-      "computer",
-    };
-    Board board;
-    Color mycolor = kBlack;
-    bool first_move = true;
-
-    while (std::getline(std::cin, line)) {
-      std::string command = line.substr(0, line.find(" "));
-      if (command == "quit") {
-        return 0;
-      } else if (command == "protover") {
-        std::cout << "feature reuse=0 sigint=0 sigterm=0" << std::endl;
-      } else if (command == "white") {
-        mycolor = kWhite;
-      } else if (command == "black") {
-        mycolor = kBlack;
-      } else if (command == "go" && first_move) {
-        auto valid_ai_moves = board.GetMoves();
-        Move ai_move = ChooseAiMove(board, mycolor, kDepth, kUtility, cache);
-        board.DoMove(ai_move);
-        board.NewTurn();
-
-        std::cout << "move " << ai_move.XboardString() << std::endl;
-      } else if (ignored.find(command) != ignored.end()) {
-        // ignore
-      } else {
-        // not a known command, must be a move
-        first_move = false;
-        auto human_move = Move::FromXboardString(command);
-        if (!human_move.has_value()) {
-          std::cout << "Ilegal move: " << command << std::endl;
-          continue;
-        }
-        board.DoMove(*human_move);
-        board.NewTurn();
-
-        auto valid_ai_moves = board.GetMoves();
-        switch (board.GetGameOutcome()) {
-          case kCheckmate:
-            std::cout << "1-0 {White mates}" << std::endl;
-            continue;
-          case kDraw:
-            std::cout << "1/2-1/2 {draw}" << std::endl;
-            continue;
-          case kInProgress:
-            break;
-        }
-
-        Move ai_move = ChooseAiMove(board, mycolor, kDepth, kUtility, cache);
-        board.DoMove(ai_move);
-        board.NewTurn();
-
-        std::cout << "move " << ai_move.XboardString() << std::endl;
-
-        auto valid_human_moves = board.GetMoves();
-        switch (board.GetGameOutcome()) {
-          case kCheckmate:
-            std::cout << "0-1 {Black mates}" << std::endl;
-            continue;
-          case kDraw:
-            std::cout << "1/2-1/2 {draw}" << std::endl;
-            continue;
-          case kInProgress:
-            break;
-        }
-      }
+    if (!cache_path.empty() &&
+        !SaveCacheSnapshot(cache, cache_path, evaluator)) {
+      std::cerr << "Could not save the cache to " << cache_path << std::endl;
+      return 1;
     }
   }
 
@@ -0,0 +1,131 @@
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "board.h"
+#include "cache.h"
+#include "color.h"
+#include "engine.h"
+#include "move.h"
+#include "piece.h"
+#include "position.h"
+
+namespace {
+
+struct NamedPosition {
+  const char* name;
+  const char* fen;
+};
+
+const NamedPosition kPositions[] = {
+  {"start", "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"},
+  {"middlegame",
+   "r1bq1rk1/ppp1nppp/4n3/3p3Q/3P4/1BP1B3/PP1N2PP/R4RK1 w - - 1 16"},
+  {"endgame", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 11"},
+};
+
+const char* const kPieceNames[] = {"pawn", "knight", "bishop",
+                                   "rook", "queen",  "king"};
+
+Board SetUp(benchmark::State& state) {
+  const NamedPosition& position = kPositions[state.range(0)];
+  state.SetLabel(position.name);
+  return *Board::FromFen(position.fen);
+}
+
+void AllPositions(benchmark::internal::Benchmark* benchmark) {
+  benchmark->DenseRange(0, std::size(kPositions) - 1);
+}
+
+void BM_BoardCopy(benchmark::State& state) {
+  Board board = SetUp(state);
+  for (auto _ : state) {
+    Board copy(board);
+    benchmark::DoNotOptimize(copy);
+  }
+}
+BENCHMARK(BM_BoardCopy)->Apply(AllPositions);
+
+void BM_BoardHash(benchmark::State& state) {
+  Board board = SetUp(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(board.Hash());
+  }
+}
+BENCHMARK(BM_BoardHash)->Apply(AllPositions);
+
+void BM_BoardIsCheck(benchmark::State& state) {
+  Board board = SetUp(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(board.IsCheck(board.CurrentPlayer()));
+  }
+}
+BENCHMARK(BM_BoardIsCheck)->Apply(AllPositions);
+
+// GetMoves is memoized per turn, so this times the generator behind it.
+void BM_BoardGetMoves(benchmark::State& state) {
+  Board board = SetUp(state);
+  std::vector<Move> moves;
+  for (auto _ : state) {
+    moves.clear();
+    board.GenerateMoves(kAllMoves, moves);
+    benchmark::DoNotOptimize(moves.data());
+  }
+}
+BENCHMARK(BM_BoardGetMoves)->Apply(AllPositions);
+
+// Every piece of one type, of both colors.
+void BM_PieceGetMoves(benchmark::State& state) {
+  Board board = SetUp(state);
+  PieceType type = static_cast<PieceType>(state.range(1));
+  state.SetLabel(std::string(kPositions[state.range(0)].name) + "/" +
+                 kPieceNames[state.range(1)]);
+  std::vector<Position> squares;
+  for (int x = 0; x <= 7; ++x) {
+    for (int y = 0; y <= 7; ++y) {
+      const Piece* piece = board.GetPiece({x, y});
+      if (piece != nullptr && piece->Type() == type) {
+        squares.emplace_back(x, y);
+      }
+    }
+  }
+  for (auto _ : state) {
+    for (Position square : squares) {
+      benchmark::DoNotOptimize(board.GetPiece(square)->GetMoves(board, square));
+    }
+  }
+}
+BENCHMARK(BM_PieceGetMoves)
+    ->ArgsProduct({benchmark::CreateDenseRange(0, std::size(kPositions) - 1, 1),
+                   benchmark::CreateDenseRange(0, 5, 1)});
+
+template <typename Utility>
+void BM_Evaluate(benchmark::State& state) {
+  Board board = SetUp(state);
+  Utility utility;
+  utility.Reset(board);
+  Color attackingcolor = Other(board.CurrentPlayer());
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(utility.Evaluate(board, attackingcolor));
+  }
+}
+BENCHMARK_TEMPLATE(BM_Evaluate, MaterialisticUtility)->Apply(AllPositions);
+BENCHMARK_TEMPLATE(BM_Evaluate, SmartUtility)->Apply(AllPositions);
+
+// Each search starts with an empty cache.
+void BM_ComputeUtility(benchmark::State& state) {
+  Board board = SetUp(state);
+  SmartUtility utility;
+  for (auto _ : state) {
+    Cache cache;
+    benchmark::DoNotOptimize(ComputeUtility(board, board.CurrentPlayer(),
+                                            state.range(1), utility, cache));
+  }
+}
+BENCHMARK(BM_ComputeUtility)
+    ->ArgsProduct({{0, 2}, {1, 2, 3}})
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+BENCHMARK_MAIN();
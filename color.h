@@ -1,6 +1,8 @@
 #ifndef COLOR_H_
 #define COLOR_H_
 
+#include <string>
+
 enum Color { kWhite, kBlack };
 
 Color Other(Color color);
@@ -1,13 +1,23 @@
 #include <algorithm>
+#include <array>
 #include <cmath>
+#include <cstdlib>
 #include <iostream>
-#include <limits>
+#include <optional>
+#include <span>
 
+#include "batch.h"
+#include "bitbase.h"
 #include "board.h"
 #include "color.h"
 #include "engine.h"
 #include "move.h"
+#include "movepicker.h"
 #include "cache.h"
+#include "common.h"
+#include "score.h"
+#include "tablebase.h"
+#include "trace.h"
 
 static int multiplier(Color color) {
   return color == kWhite ? 1 : -1;
@@ -21,29 +31,37 @@ bool ColorfulCompare::operator()(const Move& a, const Move& b) {
   return (multiplier_ * a.Utility()) < (multiplier_ * b.Utility());
 }
 
-double MaterialisticUtility(Board& board, Color attackingcolor) {
+Score MaterialisticUtility::Evaluate(const Board& board, Color attackingcolor) {
   switch (board.GetGameOutcome()) {
     case kCheckmate:
-      return multiplier(attackingcolor) * std::numeric_limits<double>::infinity();
+      return MateScore(attackingcolor, 0);
     case kDraw:
-      return 0.0;
+      return 0;
     default:
-      float utility = 0;
+      Score utility = 0;
 
       for (auto piece : board.GetPieces()) {
         utility += piece->Value() * multiplier(piece->GetColor());
       }
 
-      return utility;
+      return utility * kCentipawnsPerPawn;
   }
 }
 
-double SmartUtility(Board& board, Color attackingcolor) {
+void MaterialisticUtility::Reset(unused const Board& board) {}
+
+void MaterialisticUtility::DoMove(unused const Board& board,
+                                  unused const Move& move) {}
+
+void MaterialisticUtility::UndoMove(unused const Board& board,
+                                    unused const Move& move) {}
+
+Score SmartUtility::Evaluate(const Board& board, Color attackingcolor) {
   switch (board.GetGameOutcome()) {
     case kCheckmate:
-      return multiplier(attackingcolor) * std::numeric_limits<double>::infinity();
+      return MateScore(attackingcolor, 0);
     case kDraw:
-      return 0.0;
+      return 0;
     default:
       float utility = 0;
       float my_value = 0;
@@ -61,81 +79,485 @@ double SmartUtility(Board& board, Color attackingcolor) {
       float space = 0.1 * board.CountTargetedSquares(attackingcolor);
       float ratio = std::sqrt(my_value / their_value);
 
-      return utility * space * ratio;
+      float centipawns = utility * space * ratio * kCentipawnsPerPawn;
+      return std::lround(std::clamp<float>(centipawns, 1 - kMateInMaxPly,
+                                           kMateInMaxPly - 1));
+  }
+}
+
+void SmartUtility::Reset(unused const Board& board) {}
+
+void SmartUtility::DoMove(unused const Board& board, unused const Move& move) {}
+
+void SmartUtility::UndoMove(unused const Board& board,
+                            unused const Move& move) {}
+
+std::vector<Move> PrincipalVariation(const Board& board, const Move& best,
+                                     const Cache& cache, int max_length) {
+  std::vector<Move> pv = {best};
+  Board position = board;
+  position.DoMove(best);
+  position.NewTurn();
+  while (static_cast<int>(pv.size()) < max_length) {
+    const CacheEntry* cached =
+        cache.Find(std::hash<std::string>{}(position.Hash()));
+    if (cached == nullptr || cached->move == kNoMove) {
+      break;
+    }
+    Move move = Move::Unpack(cached->move);
+    if (!position.IsLegalMove(move)) {
+      break;
+    }
+    pv.push_back(move);
+    position.DoMove(move);
+    position.NewTurn();
   }
+  return pv;
 }
 
-bool IsUtilityBetterThan(float a, float b, Color color) {
+bool IsUtilityBetterThan(Score a, Score b, Color color) {
   auto x = multiplier(color);
   return a * x > b * x;
 }
 
-class CapturesFirst {
- public:
-  CapturesFirst(const Board& board) : board_(board) {}
-  bool operator()(const Move& a, const Move& b) {
-    auto to_a = board_.GetPiece(a.To());
-    auto to_b = board_.GetPiece(b.To());
-    return (to_a == nullptr && to_b != nullptr) || (to_a != nullptr && to_b != nullptr && to_a->Value() < to_b->Value());
-  }
- private:
-  const Board& board_;
+namespace {
+
+// Evaluators that score many boards faster than one at a time.
+template <typename Utility>
+concept EvaluatesBatches = requires(Utility& utility,
+                                    std::span<const Board> boards,
+                                    std::span<Score> scores) {
+  utility.EvaluateBatch(boards, scores);
 };
 
-void ComputeUtilityInternal(
-  const Board& parent_board,
+struct SearchState {
+  SearchState(Cache& cache, SearchLimits& limits)
+      : cache(cache), limits(limits) {}
+
+  Cache& cache;
+  SearchLimits& limits;
+  // Quiet moves that caused a cutoff, by ply, tried right after captures.
+  std::array<std::array<uint16_t, 2>, kMaxPly> killers = {};
+};
+
+void AddKiller(SearchState& state, int ply, const Move& move) {
+  auto& killers = state.killers[ply];
+  uint16_t packed = move.Pack();
+  if (killers[0] != packed) {
+    killers[1] = killers[0];
+    killers[0] = packed;
+  }
+}
+
+// Counts a node, and returns whether the search has to stop. The clock is
+// only read every so often, the stop flag at every node.
+bool Stop(SearchLimits& limits) {
+  ++limits.nodes;
+  if (limits.max_nodes != 0 && limits.nodes > limits.max_nodes) {
+    limits.stopped = true;
+  } else if (limits.stop != nullptr &&
+             limits.stop->load(std::memory_order_relaxed)) {
+    limits.stopped = true;
+  } else if (limits.deadline.has_value() && limits.nodes % 1024 == 0) {
+    TRACE_INSTANT("time check", limits.nodes);
+    limits.stopped = std::chrono::steady_clock::now() >= *limits.deadline;
+  }
+  return limits.stopped;
+}
+
+// The search's score for a tablebase result of the side to move.
+Score TablebaseScore(Wdl wdl, Color color) {
+  switch (wdl) {
+    case Wdl::kWin:
+      return multiplier(color) * kTablebaseWin;
+    case Wdl::kLoss:
+      return -multiplier(color) * kTablebaseWin;
+    default:
+      return 0;
+  }
+}
+
+// A bitbase win scores less the later the search gets into it, so that it
+// converts to the ending rather than heading for it.
+Score BitbaseScore(Score score, int ply) {
+  return score > 0 ? score - ply : score < 0 ? score + ply : 0;
+}
+
+std::optional<Wdl> ProbeTablebases(const Board& board, SearchLimits& limits) {
+  // Bitbase wins are searched on, for the search to find the mate.
+  if (ProbeBitbases(board) == 0) {
+    ++limits.stats.tablebase_hits;
+    return Wdl::kDraw;
+  }
+  if (limits.tablebases == nullptr) {
+    return {};
+  }
+  auto wdl = limits.tablebases->ProbeWdl(board);
+  if (wdl.has_value()) {
+    ++limits.stats.tablebase_hits;
+  }
+  return wdl;
+}
+
+// Scores every legal move from the tables, if they answer all of them, so
+// that the winning side heads for the quickest conversion and the losing side
+// holds out longest.
+std::optional<std::vector<Move>> RankByTablebases(const Board& board,
+                                                  Color mycolor,
+                                                  SearchLimits& limits) {
+  std::vector<Move> moves = board.GetMoves();
+  if (moves.empty()) {
+    return {};
+  }
+  for (Move& move : moves) {
+    Board child = board;
+    child.DoMove(move);
+    child.NewTurn();
+    auto wdl = ProbeTablebases(child, limits);
+    auto dtz = limits.tablebases->ProbeDtz(child);
+    if (!wdl.has_value() || !dtz.has_value()) {
+      return {};
+    }
+    Score score = TablebaseScore(*wdl, Other(mycolor));
+    if (score > 0) {
+      score -= std::abs(*dtz);
+    } else if (score < 0) {
+      score += std::abs(*dtz);
+    }
+    move.SetUtility(score);
+  }
+  return moves;
+}
+
+// Only captures that don't lose material are searched past the horizon, so
+// that leaves are evaluated once the exchanges on the board are resolved.
+// Either side can also stand pat and keep the static evaluation, which the
+// caller may have computed already.
+template <typename Utility>
+Score Quiescence(
+  const Board& board,
+  Color mycolor,
+  int ply,
+  Score theirbest,
+  Utility& utility,
+  SearchLimits& limits,
+  std::optional<Score> static_eval = std::nullopt
+) {
+  if (Stop(limits)) {
+    return 0;
+  }
+  ++limits.stats.quiescence_nodes;
+  limits.stats.selective_depth = std::max(limits.stats.selective_depth, ply);
+  auto theircolour = Other(mycolor);
+  auto outcome = board.GetGameOutcome();
+  if (outcome == kCheckmate) {
+    return MateScore(theircolour, ply);
+  }
+  if (outcome == kInProgress) {
+    if (auto score = ProbeBitbases(board)) {
+      ++limits.stats.tablebase_hits;
+      return BitbaseScore(*score, ply);
+    }
+  }
+  Score mybest;
+  if (static_eval.has_value()) {
+    mybest = outcome == kDraw ? 0 : *static_eval;
+  } else {
+    TRACE_SCOPE("eval", ply);
+    mybest = utility.Evaluate(board, theircolour);
+  }
+  if (IsUtilityBetterThan(mybest, theirbest, mycolor) || ply >= kMaxPly - 1) {
+    return mybest;
+  }
+  MovePicker picker(board);
+  while (auto move = picker.Next()) {
+    Board child = board;
+    child.DoMove(*move);
+    child.NewTurn();
+    utility.DoMove(board, *move);
+    Score score = Quiescence(child, theircolour, ply + 1, mybest, utility, limits);
+    utility.UndoMove(board, *move);
+    if (limits.stopped) {
+      break;
+    }
+    if (IsUtilityBetterThan(score, mybest, mycolor)) {
+      mybest = score;
+    }
+    if (IsUtilityBetterThan(score, theirbest, mycolor)) {
+      break;
+    }
+  }
+  return mybest;
+}
+
+// Returns the utility of `board`, with `mycolor` to move, looking `depth`
+// plies ahead. It stops at the first move better than `theirbest`, since the
+// caller already has a better option than this position. `board_hash` is
+// the cache key of `board`, which the caller computes right after making the
+// move, to prefetch its bucket while the evaluator catches up.
+template <typename Utility>
+Score ComputeUtilityInternal(
+  const Board& board,
+  size_t board_hash,
   Color mycolor,
   int depth,
-  float theirbest,
-  double (*utility)(Board& board, Color attackingcolor),
-  std::vector<Move>& moves,
-  Cache& cache
+  int ply,
+  Score theirbest,
+  Utility& utility,
+  SearchState& state,
+  std::optional<Score> static_eval = std::nullopt
 ) {
+  // Quiescence counts the nodes at the horizon.
+  if (depth > 0 && Stop(state.limits)) {
+    return 0;
+  }
+  state.limits.stats.selective_depth =
+      std::max(state.limits.stats.selective_depth, ply);
   auto theircolour = Other(mycolor);
-  float mybest = multiplier(theircolour) * std::numeric_limits<double>::infinity();
-  size_t c = 0;
-  std::sort(moves.rbegin(), moves.rend(), CapturesFirst(parent_board));
-  for (auto it = moves.begin(); it != moves.end(); ++it) {
-    Board board = parent_board;
-    board.DoMove(*it);
-    board.NewTurn();
-    int board_hash = std::hash<std::string>{}(board.Hash() + "_" + std::to_string(depth));
-    auto cached_utility = cache.find(board_hash);
-    if (cached_utility != cache.end()) {
-      it->SetUtility(cached_utility->second);
-    } else {
-      std::vector<Move> theirmoves = board.GetMoves();
-      if (depth == 0 || board.GetGameOutcome() != kInProgress) {
-        it->SetUtility(utility(board, mycolor));
+  uint16_t cache_move = kNoMove;
+  const CacheEntry* cached = state.cache.Find(board_hash);
+  bool replace = cached != nullptr;
+  ++state.limits.stats.cache_probes;
+  if (replace) {
+    ++state.limits.stats.cache_hits;
+    if (cached->depth == depth) {
+      return ScoreFromCache(cached->utility, ply);
+    }
+    cache_move = cached->move;
+  }
+
+  Score mybest = multiplier(theircolour) * kInfinity;
+  uint16_t best_move = cache_move;
+  if (depth == 0) {
+    mybest = Quiescence(board, mycolor, ply, theirbest, utility, state.limits,
+                        static_eval);
+    if (state.limits.stopped) {
+      return 0;
+    }
+  } else if (board.IsRepetition()) {
+    mybest = 0;
+  } else if (auto wdl = ProbeTablebases(board, state.limits)) {
+    mybest = TablebaseScore(*wdl, mycolor);
+  } else {
+    MovePicker picker(board, cache_move, state.killers[ply]);
+    // Right above the horizon, a batching evaluator scores all the children
+    // at once, in the order the picker yields them.
+    std::vector<Move> leaf_moves;
+    std::vector<Board> leaves;
+    std::vector<Score> leaf_scores;
+    if constexpr (EvaluatesBatches<Utility>) {
+      if (depth == 1) {
+        while (auto move = picker.Next()) {
+          leaf_moves.push_back(*move);
+          Board& child = leaves.emplace_back(board);
+          child.DoMove(*move);
+          child.NewTurn();
+        }
+        leaf_scores.resize(leaves.size());
+        TRACE_SCOPE("eval batch", leaves.size());
+        utility.EvaluateBatch(leaves, leaf_scores);
+      }
+    }
+    size_t leaf = 0;
+    auto next = [&]() -> std::optional<Move> {
+      if (leaves.empty()) {
+        return picker.Next();
+      }
+      if (leaf == leaves.size()) {
+        return std::nullopt;
+      }
+      return leaf_moves[leaf++];
+    };
+    int searched = 0;
+    while (auto move = next()) {
+      ++searched;
+      bool quiet = board.GetPiece(move->To()) == nullptr && !move->PromoteTo().has_value();
+      std::optional<Board> played;
+      std::optional<Score> child_eval;
+      Board* child;
+      if (leaves.empty()) {
+        child = &played.emplace(board);
+        child->DoMove(*move);
+        child->NewTurn();
       } else {
-        ComputeUtilityInternal(board, theircolour, depth-1, mybest, utility, theirmoves, cache);
-        auto theirbest = std::max_element(theirmoves.begin(), theirmoves.end(), ColorfulCompare(theircolour));
-        it->SetUtility(theirbest->Utility());
+        child = &leaves[leaf - 1];
+        child_eval = leaf_scores[leaf - 1];
+      }
+      size_t child_hash = std::hash<std::string>{}(child->Hash());
+      state.cache.Prefetch(child_hash);
+      utility.DoMove(board, *move);
+      Score score = ComputeUtilityInternal(*child, child_hash, theircolour, depth - 1, ply + 1, mybest, utility, state, child_eval);
+      utility.UndoMove(board, *move);
+      if (state.limits.stopped) {
+        return 0;
+      }
+      if (IsUtilityBetterThan(score, mybest, mycolor)) {
+        mybest = score;
+        best_move = move->Pack();
+      }
+      if (IsUtilityBetterThan(score, theirbest, mycolor)) {
+        // We might as well stop now as the calling function already has a better solution than this.
+        ++state.limits.stats.cutoffs;
+        if (searched == 1) {
+          ++state.limits.stats.first_move_cutoffs;
+        }
+        if (quiet) {
+          AddKiller(state, ply, *move);
+        }
+        break;
       }
-      cache[board_hash] = it->Utility();
     }
-    if (IsUtilityBetterThan(it->Utility(), mybest, mycolor)) {
-      mybest = it->Utility();
+    if (searched == 0) {
+      mybest = board.IsCheck(mycolor) ? MateScore(theircolour, ply) : 0;
     }
-    ++c;
-    if (IsUtilityBetterThan(theirbest, it->Utility(), theircolour)) {
-      // We might as well stop now as the calling function already has a better solution than this.
-      break;
+    // Unless the search found the mate.
+    if (auto score = ProbeBitbases(board); score.has_value() && !IsMateScore(mybest)) {
+      ++state.limits.stats.tablebase_hits;
+      mybest = BitbaseScore(*score, ply);
     }
   }
-  if (c < moves.size()) {
-    moves.erase(moves.begin() + c, moves.end());
+  if (replace) {
+    TRACE_INSTANT("tt replace", depth);
   }
+  state.cache.Store(board_hash, {static_cast<int16_t>(ScoreToCache(mybest, ply)), static_cast<int16_t>(depth), best_move});
+  return mybest;
 }
 
+}  // namespace
+
+template <typename Utility>
 std::vector<Move> ComputeUtility(
-  Board board,
+  const Board& board,
   Color mycolor,
   int depth,
-  double (*utility)(Board& board, Color attackingcolor),
+  Utility& utility,
   Cache& cache
 ) {
-  std::vector<Move> moves = board.GetMoves();
-  ComputeUtilityInternal(board, mycolor, depth, multiplier(mycolor) * std::numeric_limits<double>::infinity(), utility, moves, cache);
+  SearchLimits limits;
+  return ComputeUtility(board, mycolor, depth, utility, cache, limits);
+}
+
+template <typename Utility>
+std::vector<Move> ComputeUtility(
+  const Board& board,
+  Color mycolor,
+  int depth,
+  Utility& utility,
+  Cache& cache,
+  SearchLimits& limits
+) {
+  SearchState state(cache, limits);
+  utility.Reset(board);
+  auto theircolour = Other(mycolor);
+  Score mybest = multiplier(theircolour) * kInfinity;
+  uint16_t cache_move = kNoMove;
+  const CacheEntry* cached =
+      cache.Find(std::hash<std::string>{}(board.Hash()));
+  if (cached != nullptr) {
+    cache_move = cached->move;
+  }
+  std::vector<Move> moves;
+  MovePicker picker(board, cache_move, state.killers[0]);
+  while (auto move = picker.Next()) {
+    TRACE_SCOPE("root move", move->Pack());
+    Board child = board;
+    child.DoMove(*move);
+    child.NewTurn();
+    size_t child_hash = std::hash<std::string>{}(child.Hash());
+    cache.Prefetch(child_hash);
+    utility.DoMove(board, *move);
+    move->SetUtility(ComputeUtilityInternal(child, child_hash, theircolour, depth, 1, mybest, utility, state));
+    utility.UndoMove(board, *move);
+    if (limits.stopped) {
+      break;
+    }
+    if (IsUtilityBetterThan(move->Utility(), mybest, mycolor)) {
+      mybest = move->Utility();
+      if (limits.new_best) {
+        limits.new_best(*move);
+      }
+    }
+    moves.push_back(*move);
+  }
   return moves;
 }
+
+#define INSTANTIATE_SEARCH(Utility)                                         \
+  template std::vector<Move> ComputeUtility<Utility>(                      \
+      const Board& board, Color mycolor, int depth, Utility& utility,       \
+      Cache& cache);                                                        \
+  template std::vector<Move> ComputeUtility<Utility>(                      \
+      const Board& board, Color mycolor, int depth, Utility& utility,       \
+      Cache& cache, SearchLimits& limits);
+
+INSTANTIATE_SEARCH(MaterialisticUtility)
+INSTANTIATE_SEARCH(SmartUtility)
+INSTANTIATE_SEARCH(BatchUtility)
+INSTANTIATE_SEARCH(NnueUtility)
+
+std::vector<Move> ComputeUtility(
+  const Board& board,
+  Color mycolor,
+  int depth,
+  AnyUtility& utility,
+  Cache& cache
+) {
+  SearchLimits limits;
+  return ComputeUtility(board, mycolor, depth, utility, cache, limits);
+}
+
+std::vector<Move> ComputeUtility(
+  const Board& board,
+  Color mycolor,
+  int depth,
+  AnyUtility& utility,
+  Cache& cache,
+  SearchLimits& limits
+) {
+  return std::visit([&](auto& concrete) {
+    return ComputeUtility(board, mycolor, depth, concrete, cache, limits);
+  }, utility);
+}
+
+std::vector<Move> SearchIteratively(
+  const Board& board,
+  Color mycolor,
+  int max_depth,
+  AnyUtility& utility,
+  Cache& cache,
+  SearchLimits& limits,
+  const std::function<void(int depth, const std::vector<Move>& moves)>& report
+) {
+  if (limits.tablebases != nullptr) {
+    if (auto moves = RankByTablebases(board, mycolor, limits)) {
+      std::sort(moves->begin(), moves->end(), ColorfulCompare(mycolor));
+      if (report) {
+        report(0, *moves);
+      }
+      return *moves;
+    }
+  }
+  cache.NewSearch();
+  std::vector<Move> best_last;
+  for (int depth = 0; depth <= max_depth; ++depth) {
+    TRACE_SCOPE("iteration", depth);
+    auto moves = ComputeUtility(board, mycolor, depth, utility, cache, limits);
+    if (limits.stopped) {
+      if (best_last.empty()) {
+        best_last = moves.empty() ? board.GetMoves() : moves;
+        std::sort(best_last.begin(), best_last.end(), ColorfulCompare(mycolor));
+      }
+      break;
+    }
+    // The game is over.
+    if (moves.empty()) {
+      break;
+    }
+    std::sort(moves.begin(), moves.end(), ColorfulCompare(mycolor));
+    best_last = std::move(moves);
+    if (report) {
+      report(depth, best_last);
+    }
+  }
+  return best_last;
+}
@@ -1,21 +1,139 @@
 #ifndef ENGINE_H_
 #define ENGINE_H_
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <variant>
 #include <vector>
 
+#include "batch.h"
 #include "board.h"
 #include "color.h"
 #include "cache.h"
+#include "move.h"
+#include "nnue.h"
+#include "score.h"
+#include "tablebase.h"
+
+// Evaluators are policies of the search. Besides Evaluate, the search calls
+// Reset with the root board and DoMove/UndoMove around every child it visits,
+// always with the board the move is played on, so an evaluator can keep
+// incremental state.
+class MaterialisticUtility {
+ public:
+  Score Evaluate(const Board& board, Color attackingcolor);
+  void Reset(const Board& board);
+  void DoMove(const Board& board, const Move& move);
+  void UndoMove(const Board& board, const Move& move);
+};
+
+class SmartUtility {
+ public:
+  Score Evaluate(const Board& board, Color attackingcolor);
+  void Reset(const Board& board);
+  void DoMove(const Board& board, const Move& move);
+  void UndoMove(const Board& board, const Move& move);
+};
+
+// Counters a search adds to as it goes.
+struct SearchStats {
+  uint64_t quiescence_nodes = 0;
+  uint64_t cache_probes = 0;
+  uint64_t cache_hits = 0;
+  uint64_t cutoffs = 0;
+  // Cutoffs by the first move searched, a measure of move ordering.
+  uint64_t first_move_cutoffs = 0;
+  // The deepest ply reached, quiescence included.
+  int selective_depth = 0;
+  uint64_t tablebase_hits = 0;
+};
+
+// Stops a search after `max_nodes` nodes or at `deadline`, whichever comes
+// first. Zero and nullopt mean no limit. Once the search has stopped, the
+// utilities it returns are meaningless.
+struct SearchLimits {
+  uint64_t max_nodes = 0;
+  std::optional<std::chrono::steady_clock::time_point> deadline;
+  // Set from another thread to stop the search at the next node.
+  const std::atomic<bool>* stop = nullptr;
+  // Called at the root whenever a move beats the ones searched before it.
+  std::function<void(const Move& move)> new_best;
+  // If set, positions the tables answer aren't searched any further, and
+  // SearchIteratively plays from them at the root.
+  const Tablebases* tablebases = nullptr;
+
+  // Filled in by the search.
+  uint64_t nodes = 0;
+  bool stopped = false;
+  SearchStats stats;
+};
+
+// The search is instantiated once per evaluator, so the evaluation is inlined
+// into it. Pick one at runtime through AnyUtility.
+template <typename Utility>
+std::vector<Move> ComputeUtility(
+  const Board& board,
+  Color mycolor,
+  int depth,
+  Utility& utility,
+  Cache& cache
+);
+
+template <typename Utility>
+std::vector<Move> ComputeUtility(
+  const Board& board,
+  Color mycolor,
+  int depth,
+  Utility& utility,
+  Cache& cache,
+  SearchLimits& limits
+);
+
+typedef std::variant<MaterialisticUtility, SmartUtility, BatchUtility,
+                     NnueUtility>
+    AnyUtility;
 
 std::vector<Move> ComputeUtility(
-  Board board,
+  const Board& board,
   Color mycolor,
   int depth,
-  double (*utility)(Board& board, Color attackingcolor),
+  AnyUtility& utility,
   Cache& cache
 );
 
-double MaterialisticUtility(Board& board, Color attackingcolor);
-double SmartUtility(Board& board, Color attackingcolor);
+std::vector<Move> ComputeUtility(
+  const Board& board,
+  Color mycolor,
+  int depth,
+  AnyUtility& utility,
+  Cache& cache,
+  SearchLimits& limits
+);
+
+// Deeper than any search that fits in a time or node budget.
+const int kMaxDepth = 64;
+
+// Searches one ply deeper at a time, from depth 0 up to `max_depth`, until
+// `limits` stops it. `report`, if set, is called after each complete
+// iteration with its depth and its moves, best last. Returns the moves of the
+// last complete iteration, or if not even the first one completed, whatever
+// the search got to, or else the legal moves unsearched.
+std::vector<Move> SearchIteratively(
+  const Board& board,
+  Color mycolor,
+  int max_depth,
+  AnyUtility& utility,
+  Cache& cache,
+  SearchLimits& limits,
+  const std::function<void(int depth, const std::vector<Move>& moves)>& report
+);
+
+// Follows the best moves the cache remembers, starting with `best` on
+// `board`, for at most `max_length` moves.
+std::vector<Move> PrincipalVariation(const Board& board, const Move& best,
+                                     const Cache& cache, int max_length);
 
 class ColorfulCompare {
  public:
@@ -1,9 +1,25 @@
 #define BOOST_TEST_MODULE engine tests
 #include <boost/test/included/unit_test.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <thread>
+
+#include "allocs.h"
+#include "bitbase.h"
 #include "engine.h"
+#include "epd.h"
 #include "king.h"
+#include "mate.h"
 #include "pawn.h"
+#include "polyglot.h"
 #include "rook.h"
+#include "snapshot.h"
+#include "tablebase.h"
+#include "trace.h"
 
 BOOST_AUTO_TEST_CASE(TestCaptureFreePawn) {
   Cache cache;
@@ -14,7 +30,8 @@ BOOST_AUTO_TEST_CASE(TestCaptureFreePawn) {
   positions.emplace_back(Position(7, 7), std::make_unique<King>(kBlack));
   Board b(positions, kWhite);
 
-  auto moves = ComputeUtility(b, kWhite, 2, SmartUtility, cache);
+  SmartUtility utility;
+  auto moves = ComputeUtility(b, kWhite, 2, utility, cache);
   auto best = std::max_element(moves.begin(), moves.end(), ColorfulCompare(kWhite));
 
   BOOST_REQUIRE_EQUAL(moves.size(), 18);
@@ -36,20 +53,462 @@ BOOST_AUTO_TEST_CASE(TestFindsMate) {
   Cache cache;
   Board b(positions, kWhite);
 
-  auto moves = ComputeUtility(b, kWhite, 2, SmartUtility, cache);
+  SmartUtility utility;
+  auto moves = ComputeUtility(b, kWhite, 2, utility, cache);
   auto best = std::max_element(moves.begin(), moves.end(), ColorfulCompare(kWhite));
 
   BOOST_REQUIRE_EQUAL(moves.size(), 33);
 
   // finds mate
-  BOOST_CHECK(std::isinf(best->Utility()));
+  BOOST_CHECK(IsMateScore(best->Utility()));
+  BOOST_CHECK_EQUAL(best->Utility(), MateScore(kWhite, 3));
+}
+
+BOOST_AUTO_TEST_CASE(TestFindMateProvesShortestMate) {
+  // Mate in 3 through two sacrifices: Ra6 f6 Bxf6+ Rg7 Rxa8#.
+  auto board = Board::FromFen("r5rk/5p1p/5R2/4B3/8/8/7P/7K w - -");
+  BOOST_REQUIRE(board.has_value());
+
+  SearchLimits limits;
+  BOOST_CHECK(!FindMate(*board, 2, limits).has_value());
+  BOOST_CHECK(!limits.stopped);
+
+  auto mate = FindMate(*board, 3, limits);
+  BOOST_REQUIRE(mate.has_value());
+  BOOST_REQUIRE_EQUAL(mate->size(), 5);
+  BOOST_CHECK_EQUAL(mate->front().XboardString(), "f6a6");
+  for (const Move& move : *mate) {
+    BOOST_REQUIRE(board->IsLegalMove(move));
+    board->DoMove(move);
+    board->NewTurn();
+  }
+  board->GetMoves();
+  BOOST_CHECK_EQUAL(board->GetGameOutcome(), kCheckmate);
+
+  SearchLimits few_nodes;
+  few_nodes.max_nodes = 10;
+  BOOST_CHECK(!FindMate(*Board::FromFen("r5rk/5p1p/5R2/4B3/8/8/7P/7K w - -"),
+                        3, few_nodes).has_value());
+  BOOST_CHECK(few_nodes.stopped);
+}
+
+BOOST_AUTO_TEST_CASE(TestSearchStopsAtNodeLimit) {
+  Board b;
+  Cache cache;
+  SmartUtility utility;
+  SearchLimits limits;
+  limits.max_nodes = 100;
+  ComputeUtility(b, kWhite, 3, utility, cache, limits);
+
+  BOOST_CHECK(limits.stopped);
+  BOOST_CHECK_EQUAL(limits.nodes, 101);
+  // Nothing from the unfinished search is cached.
+  BOOST_CHECK(cache.Find(std::hash<std::string>{}(b.Hash())) == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(TestThreadsSearchSharedBoard) {
+  const Board board = *Board::FromFen(
+      "r1bqkb1r/pppp1ppp/2n2n2/4p2Q/2B1P3/8/PPPP1PPP/RNB1K1NR w KQkq - 4 4");
+  Cache cache;
+  SmartUtility utility;
+  auto expected = ComputeUtility(board, kWhite, 1, utility, cache);
+
+  // Both threads query the one board, before any of them has kept its moves.
+  const Board shared = board;
+  std::vector<std::vector<Move>> results(2);
+  std::vector<GameOutcome> outcomes(2);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 2; ++i) {
+    threads.emplace_back([&, i]() {
+      Cache cache;
+      SmartUtility utility;
+      outcomes[i] = shared.GetGameOutcome();
+      results[i] = ComputeUtility(shared, kWhite, 1, utility, cache);
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (GameOutcome outcome : outcomes) {
+    BOOST_CHECK_EQUAL(outcome, kInProgress);
+  }
+  for (const auto& result : results) {
+    BOOST_REQUIRE_EQUAL(result.size(), expected.size());
+    for (size_t i = 0; i < result.size(); ++i) {
+      BOOST_CHECK(result[i] == expected[i]);
+      BOOST_CHECK_EQUAL(result[i].Utility(), expected[i].Utility());
+    }
+  }
+  BOOST_CHECK_EQUAL(shared.GetMoves().size(), expected.size());
+}
+
+BOOST_AUTO_TEST_CASE(TestPrincipalVariationStartsWithBestMove) {
+  Board b = *Board::FromFen("6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1");
+  Cache cache;
+  SmartUtility utility;
+  SearchLimits limits;
+  auto moves = ComputeUtility(b, kWhite, 2, utility, cache, limits);
+  const Move& best =
+      *std::max_element(moves.begin(), moves.end(), ColorfulCompare(kWhite));
+  auto pv = PrincipalVariation(b, best, cache, 3);
+
+  BOOST_CHECK(!pv.empty());
+  BOOST_CHECK_EQUAL(pv[0].XboardString(), "a1a8");
+  BOOST_CHECK_GT(limits.stats.cache_probes, 0);
+  BOOST_CHECK_GT(limits.stats.cutoffs, 0);
+  BOOST_CHECK_GE(limits.stats.selective_depth, 3);
+}
+
+BOOST_AUTO_TEST_CASE(TestTraceWritesChromeTraceEvents) {
+  RecordTraceEvent("test span", 'X', 1000, 2500, 7);
+  std::ostringstream out;
+  WriteTrace(out);
+
+  BOOST_CHECK(out.str().find("{\"name\":\"test span\",\"ph\":\"X\","
+                             "\"ts\":1.000,\"dur\":2.500") !=
+              std::string::npos);
+}
+
+// About 83 today, mostly Board copies, GetPieces and the repetition table.
+// Lower it as allocations are taken out of the search, so that they don't
+// come back; the goal is zero.
+const double kAllocationsPerNode = 90;
+
+BOOST_AUTO_TEST_CASE(TestSearchAllocationBudget) {
+  Board b = *Board::FromFen(
+      "r1bq1rk1/ppp1nppp/4n3/3p3Q/3P4/1BP1B3/PP1N2PP/R4RK1 w - - 1 16");
+  Cache cache;
+  SmartUtility utility;
+  SearchLimits limits;
+  uint64_t allocations = AllocationCount();
+  ComputeUtility(b, kWhite, 1, utility, cache, limits);
+  allocations = AllocationCount() - allocations;
+
+  BOOST_TEST_MESSAGE(allocations << " allocations in " << limits.nodes
+                                 << " nodes");
+  BOOST_CHECK_LE(static_cast<double>(allocations) / limits.nodes,
+                 kAllocationsPerNode);
+}
+
+BOOST_AUTO_TEST_CASE(TestEpdSolvesMateInOne) {
+  std::string path =
+      std::filesystem::temp_directory_path() / "engine_test.epd";
+  std::ofstream(path)
+      << "6k1/5ppp/8/8/8/8/8/R5K1 w - - bm Ra8+; id \"back rank\";\n"
+      << "6k1/5ppp/8/8/8/8/8/R5K1 w - - am a1a8; id \"avoid\";\n";
+  EpdOptions options;
+  options.max_nodes = 10000;
+  options.threads = 2;
+  std::ostringstream out;
+  bool read = RunEpd(path, options, SmartUtility(), out);
+  std::remove(path.c_str());
+
+  BOOST_REQUIRE(read);
+  BOOST_CHECK(out.str().find("back rank solved Ra8") != std::string::npos);
+  BOOST_CHECK(out.str().find("avoid failed Ra8") != std::string::npos);
+  BOOST_CHECK(out.str().find("Solved 1/2") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(TestPolyglotBookProbe) {
+  // Real books need the specification's table, but any table keys a book
+  // written with it.
+  PolyglotRandoms randoms;
+  std::mt19937_64 random(7);
+  for (uint64_t& value : randoms) {
+    value = random();
+  }
+  std::string path =
+      std::filesystem::temp_directory_path() / "engine_test.bin";
+  {
+    std::ofstream file(path, std::ios::binary);
+    auto write = [&](uint64_t value, int size) {
+      for (int i = size - 1; i >= 0; --i) {
+        file.put(static_cast<char>(value >> (8 * i)));
+      }
+    };
+    // e2e4 with weight 10 and d2d4 with weight 30, from the start.
+    uint64_t key = PolyglotKey(Board(), randoms);
+    for (auto [move, weight] : {std::pair(796, 10), std::pair(731, 30)}) {
+      write(key, 8);
+      write(move, 2);
+      write(weight, 2);
+      write(0, 4);
+    }
+  }
+  auto book = PolyglotBook::Open(path, randoms, BookSelection::kBestWeight);
+  std::remove(path.c_str());
+
+  BOOST_REQUIRE(book);
+  auto move = book->Probe(Board());
+  BOOST_REQUIRE(move.has_value());
+  BOOST_CHECK_EQUAL(move->XboardString(), "d2d4");
+  auto after = Board::FromFen(
+      "rnbqkbnr/pppppppp/8/8/3P4/8/PPP1PPPP/RNBQKBNR b KQkq d3 0 1");
+  BOOST_REQUIRE(after.has_value());
+  BOOST_CHECK(!book->Probe(*after).has_value());
+#ifdef HAVE_POLYGLOT_RANDOM
+  BOOST_CHECK_EQUAL(PolyglotKey(Board(), *PolyglotRandomTable()),
+                    0x463b96181691fc9cULL);
+#endif
+}
+
+BOOST_AUTO_TEST_CASE(TestBitbases) {
+  InitBitbases();
+  auto probe = [](const char* fen) {
+    auto board = Board::FromFen(fen);
+    BOOST_REQUIRE(board.has_value());
+    return ProbeBitbases(*board);
+  };
+  // The king in front of its pawn on the sixth wins, whoever moves.
+  BOOST_CHECK_GT(*probe("4k3/8/4K3/4P3/8/8/8/8 b - - 0 1"), 0);
+  BOOST_CHECK_GT(*probe("4k3/8/4K3/4P3/8/8/8/8 w - - 0 1"), 0);
+  // Not with a rook pawn and the king in the corner, nor for black.
+  BOOST_CHECK_EQUAL(*probe("7k/8/8/8/8/8/7P/7K w - - 0 1"), 0);
+  BOOST_CHECK_LT(*probe("8/8/8/8/8/k7/p7/2K5 b - - 0 1"), 0);
+  BOOST_CHECK_GT(*probe("8/8/8/4k3/8/8/8/R3K3 b - - 0 1"), 0);
+  BOOST_CHECK_EQUAL(*probe("8/8/8/8/8/3k4/3R4/7K b - - 0 1"), 0);
+  BOOST_CHECK_EQUAL(*probe("k7/2Q5/1K6/8/8/8/8/8 b - - 0 1"), 0);
+  BOOST_CHECK_GT(*probe("8/8/3k4/8/8/8/8/2BNK3 b - - 0 1"), 0);
+  BOOST_CHECK_EQUAL(*probe("8/8/8/8/8/8/3k4/2B1K1N1 b - - 0 1"), 0);
+  BOOST_CHECK(!probe("8/8/3k4/8/8/8/8/2NNK3 b - - 0 1").has_value());
+  BOOST_CHECK(!probe("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1")
+                   .has_value());
+}
+
+BOOST_AUTO_TEST_CASE(TestTablebasesAnswerDeadDraws) {
+  std::filesystem::path directory =
+      std::filesystem::temp_directory_path() / "engine_test_syzygy";
+  std::filesystem::create_directories(directory);
+  const char kWdlMagic[] = "\x71\xe8\x23\x5d";
+  std::ofstream(directory / "KNvK.rtbw", std::ios::binary).write(kWdlMagic, 4);
+  std::ofstream(directory / "KQvK.rtbw", std::ios::binary) << "junk";
+  std::ofstream(directory / "README.txt") << "KQvK";
+  auto tablebases = Tablebases::Open(directory.string() + ":/nonexistent");
+  std::filesystem::remove_all(directory);
+
+  BOOST_CHECK_EQUAL(tablebases->NumTables(), 1u);
+  BOOST_CHECK_EQUAL(tablebases->Cardinality(), 3);
+  auto board = Board::FromFen("8/8/4k3/8/8/2N5/8/4K3 w - - 0 1");
+  BOOST_REQUIRE(board.has_value());
+  auto wdl = tablebases->ProbeWdl(*board);
+  BOOST_REQUIRE(wdl.has_value());
+  BOOST_CHECK(*wdl == Wdl::kDraw);
+
+  // The root is answered without searching.
+  Cache cache;
+  AnyUtility utility = SmartUtility();
+  SearchLimits limits;
+  limits.tablebases = tablebases.get();
+  auto moves = SearchIteratively(*board, kWhite, 2, utility, cache, limits,
+                                 nullptr);
+  BOOST_REQUIRE(!moves.empty());
+  BOOST_CHECK_EQUAL(moves.back().Utility(), 0);
+  BOOST_CHECK_EQUAL(limits.nodes, 0u);
+  BOOST_CHECK_EQUAL(limits.stats.tablebase_hits, moves.size());
+}
+
+std::string WriteRandomNetwork() {
+  std::string path =
+      std::filesystem::temp_directory_path() / "engine_test.nnue";
+  std::ofstream file(path, std::ios::binary);
+  std::mt19937 random(42);
+  auto write = [&](auto value) {
+    file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+  };
+  write(kNnueMagic);
+  write(kNnueVersion);
+  for (int i = 0; i < kNnueAccumulator; ++i) {
+    write(int16_t(random() % 64));
+  }
+  for (int i = 0; i < kNnueFeatures * kNnueAccumulator; ++i) {
+    write(int16_t(random() % 33 - 16));
+  }
+  for (int i = 0; i < kNnueHidden; ++i) {
+    write(int32_t(random() % 1000 - 500));
+  }
+  for (int i = 0; i < kNnueHidden * 2 * kNnueAccumulator; ++i) {
+    write(int8_t(random() % 256 - 128));
+  }
+  write(int32_t(0));
+  for (int i = 0; i < kNnueHidden; ++i) {
+    write(int8_t(random() % 256 - 128));
+  }
+  return path;
+}
+
+BOOST_AUTO_TEST_CASE(TestCacheReplacesOldAndShallowEntries) {
+  Cache cache(1);
+  // Keys a bucket count apart share a bucket of four.
+  size_t buckets = cache.Capacity() / 4;
+  auto key = [&](int i) { return 7 + i * buckets; };
+  for (int i = 0; i < 4; ++i) {
+    cache.Store(key(i), {0, static_cast<int16_t>(i == 1 ? 1 : 5), 0});
+  }
+  cache.Store(key(4), {0, 2, 0});
+  BOOST_CHECK(cache.Find(key(1)) == nullptr);
+  BOOST_REQUIRE(cache.Find(key(4)) != nullptr);
+  BOOST_CHECK_EQUAL(cache.Find(key(4))->depth, 2);
+
+  // A newer search replaces the older ones first, however deep.
+  cache.NewSearch();
+  cache.Store(key(5), {0, 0, 0});
+  cache.Store(key(6), {0, 0, 0});
+  BOOST_CHECK(cache.Find(key(4)) == nullptr);
+  BOOST_CHECK(cache.Find(key(5)) != nullptr);
+  BOOST_CHECK(cache.Find(key(6)) != nullptr);
+  BOOST_CHECK_EQUAL(cache.Size(), 4);
+
+  cache.Resize(2);
+  BOOST_CHECK_EQUAL(cache.Capacity(), 2 * buckets * 4);
+  BOOST_CHECK_EQUAL(cache.Size(), 4);
+  BOOST_CHECK(cache.Find(key(6)) != nullptr);
+
+  cache.KeepAcrossGames(true);
+  cache.NewGame();
+  BOOST_CHECK_EQUAL(cache.Size(), 4);
+  cache.KeepAcrossGames(false);
+  cache.NewGame();
+  BOOST_CHECK_EQUAL(cache.Size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(TestCacheSnapshotRoundTrip) {
+  Board b;
+  Cache cache;
+  SmartUtility utility;
+  ComputeUtility(b, kWhite, 2, utility, cache);
+  BOOST_REQUIRE(cache.Size() > 0);
+  std::string path =
+      std::filesystem::temp_directory_path() / "engine_test.cache";
+  BOOST_REQUIRE(SaveCacheSnapshot(cache, path, 1));
+
+  Cache loaded;
+  auto info = LoadCacheSnapshot(path, 1, loaded);
+  BOOST_REQUIRE(info.has_value());
+  BOOST_CHECK_EQUAL(info->entries, cache.Size());
+  BOOST_CHECK(!info->stale);
+  BOOST_REQUIRE_EQUAL(loaded.Size(), cache.Size());
+  cache.ForEach([&](size_t key, const CacheEntry& entry) {
+    const CacheEntry* copy = loaded.Find(key);
+    BOOST_REQUIRE(copy != nullptr);
+    BOOST_CHECK_EQUAL(copy->utility, entry.utility);
+    BOOST_CHECK_EQUAL(copy->depth, entry.depth);
+    BOOST_CHECK_EQUAL(copy->move, entry.move);
+  });
+
+  // Another evaluator's scores are dropped, its moves kept.
+  Cache stale;
+  info = LoadCacheSnapshot(path, 2, stale);
+  BOOST_REQUIRE(info.has_value());
+  BOOST_CHECK(info->stale);
+  cache.ForEach([&](size_t key, const CacheEntry& entry) {
+    BOOST_REQUIRE(stale.Find(key) != nullptr);
+    BOOST_CHECK_EQUAL(stale.Find(key)->depth, -1);
+    BOOST_CHECK_EQUAL(stale.Find(key)->move, entry.move);
+  });
+
+  // Entries the search never comes back to age out.
+  for (int save = 0; save < 8; ++save) {
+    BOOST_REQUIRE(SaveCacheSnapshot(loaded, path, 1));
+  }
+  Cache aged;
+  BOOST_CHECK_EQUAL(LoadCacheSnapshot(path, 1, aged)->entries, cache.Size());
+  BOOST_REQUIRE(SaveCacheSnapshot(loaded, path, 1));
+  BOOST_CHECK_EQUAL(LoadCacheSnapshot(path, 1, aged)->entries, 0);
+
+  // A flipped bit fails the checksum.
+  BOOST_REQUIRE(SaveCacheSnapshot(cache, path, 1));
+  {
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekg(40);
+    char byte = file.get();
+    file.seekp(40);
+    file.put(byte ^ 1);
+  }
+  Cache corrupt;
+  BOOST_CHECK(!LoadCacheSnapshot(path, 1, corrupt).has_value());
+  BOOST_CHECK_EQUAL(corrupt.Size(), 0);
+  std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(TestNnueIncrementalMatchesRefresh) {
+  std::string path = WriteRandomNetwork();
+  auto network = LoadNnueNetwork(path);
+  std::remove(path.c_str());
+  BOOST_REQUIRE(network != nullptr);
+  BOOST_CHECK(LoadNnueNetwork(path) == nullptr);
+
+  Board board;
+  NnueUtility incremental(network, DetectSimdLevel());
+  incremental.Reset(board);
+  for (std::string xboard : {"e2e4", "d7d5", "e4d5", "d8d5", "g1f3"}) {
+    auto move = *Move::FromXboardString(xboard);
+    incremental.DoMove(board, move);
+    board.DoMove(move);
+    board.NewTurn();
+  }
+  NnueUtility scalar(network, SimdLevel::kScalar);
+  scalar.Reset(board);
+
+  Score expected = scalar.Evaluate(board, kWhite);
+  BOOST_CHECK_NE(expected, 0);
+  BOOST_CHECK_EQUAL(incremental.Evaluate(board, kWhite), expected);
+}
+
+BOOST_AUTO_TEST_CASE(TestEvaluateBatchMatchesScalar) {
+  Board board;
+  std::vector<Board> boards;
+  for (std::string xboard : {"e2e4", "d7d5", "e4d5", "d8d5", "b1c3", "d5a5",
+                             "d2d4", "c8f5", "f1c4", "b8c6", "g1f3"}) {
+    boards.push_back(board);
+    board.DoMove(*Move::FromXboardString(xboard));
+    board.NewTurn();
+  }
+  // More boards than are laid out at once.
+  while (boards.size() < 600) {
+    boards.push_back(boards[boards.size() % 11]);
+  }
+
+  std::vector<Score> scalar(boards.size());
+  std::vector<Score> simd(boards.size());
+  EvaluateBatch(boards, scalar, SimdLevel::kScalar);
+  for (SimdLevel level : {SimdLevel::kSse41, SimdLevel::kAvx2}) {
+    if (level <= DetectSimdLevel()) {
+      EvaluateBatch(boards, simd, level);
+      BOOST_CHECK(scalar == simd);
+    }
+  }
+  // The starting position is symmetrical, e4 gains space.
+  BOOST_CHECK_EQUAL(scalar[0], 0);
+  BOOST_CHECK_GT(scalar[1], 0);
+  // Black is a pawn down after exd5.
+  BOOST_CHECK_GT(scalar[3], 50);
+  BOOST_CHECK_EQUAL(scalar[2 + 11], scalar[2]);
+}
+
+BOOST_AUTO_TEST_CASE(TestBatchUtilityFindsMate) {
+  std::vector<std::tuple<Position, std::unique_ptr<Piece>>> positions;
+  positions.emplace_back(Position(5, 0), std::make_unique<King>(kWhite));
+  positions.emplace_back(Position(0, 2), std::make_unique<Rook>(kWhite));
+  positions.emplace_back(Position(1, 1), std::make_unique<Rook>(kWhite));
+  positions.emplace_back(Position(7, 7), std::make_unique<King>(kBlack));
+  Cache cache;
+  Board b(positions, kWhite);
+
+  BatchUtility utility;
+  auto moves = ComputeUtility(b, kWhite, 2, utility, cache);
+  auto best = std::max_element(moves.begin(), moves.end(), ColorfulCompare(kWhite));
+
+  BOOST_CHECK_EQUAL(best->Utility(), MateScore(kWhite, 3));
 }
 
-void PlayAGame(Board& board) {
+// Self-play can go on forever without a fifty-move rule, so the game is cut
+// after a fixed number of plies.
+void PlayAGame(Board& board, int max_plies) {
   int depth = 2;
   Cache cache;
-  while (true) {
-    auto moves = ComputeUtility(board, board.CurrentPlayer(), depth, MaterialisticUtility, cache);
+  MaterialisticUtility utility;
+  for (int ply = 0; ply < max_plies; ++ply) {
+    auto moves = ComputeUtility(board, board.CurrentPlayer(), depth, utility, cache);
     auto best = std::max_element(moves.begin(), moves.end(), ColorfulCompare(board.CurrentPlayer()));
     board.DoMove(*best);
     board.NewTurn();
@@ -61,7 +520,7 @@ void PlayAGame(Board& board) {
 
 BOOST_AUTO_TEST_CASE(TestRegressionTest) {
   Board board;
-  PlayAGame(board);
-  BOOST_CHECK_EQUAL(board.Hash(), "R'P..r.pr'NP....pnBP....pbQP....pqK..P..pkBP....pbN.P...pnR.P.p..._black");
+  PlayAGame(board, 40);
+  BOOST_CHECK_EQUAL(board.Hash(), "R.Pp.r..NP....pnBP....pbQP....pqK'P....pk'BP....pbNP....pnR'P....pr'_white");
   BOOST_CHECK_EQUAL(board.GetGameOutcome(), kDraw);
 }
\ No newline at end of file
@@ -0,0 +1,263 @@
+#include "epd.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "board.h"
+#include "cache.h"
+#include "color.h"
+#include "engine.h"
+#include "move.h"
+#include "piece.h"
+#include "position.h"
+#include "score.h"
+
+namespace {
+
+
+struct EpdEntry {
+  std::string id;
+  std::string fen;
+  std::vector<std::string> best_moves;
+  std::vector<std::string> avoid_moves;
+};
+
+struct EpdResult {
+  bool solved = false;
+  std::string best_move;
+  // Since when the search has kept picking a right answer.
+  double seconds_to_solution = 0;
+  uint64_t nodes = 0;
+};
+
+// Splits "<fen> <op> <operands>; <op> <operands>;" into an entry. The FEN
+// has the four fields EPD keeps, without move clocks.
+std::optional<EpdEntry> ParseEpdLine(const std::string& line, int number) {
+  std::istringstream in(line);
+  EpdEntry entry;
+  for (int field = 0; field < 4; ++field) {
+    std::string value;
+    if (!(in >> value)) {
+      return {};
+    }
+    if (field > 0) {
+      entry.fen += ' ';
+    }
+    entry.fen += value;
+  }
+  entry.id = std::to_string(number);
+  std::string operation;
+  while (std::getline(in, operation, ';')) {
+    std::istringstream operands(operation);
+    std::string opcode, operand;
+    operands >> opcode;
+    if (opcode == "id") {
+      std::getline(operands >> std::ws, entry.id);
+      entry.id.erase(std::remove(entry.id.begin(), entry.id.end(), '"'),
+                     entry.id.end());
+      continue;
+    }
+    while (operands >> operand) {
+      if (opcode == "bm") {
+        entry.best_moves.push_back(operand);
+      } else if (opcode == "am") {
+        entry.avoid_moves.push_back(operand);
+      }
+    }
+  }
+  return entry;
+}
+
+char PieceLetter(PieceType type) { return "PNBRQK"[static_cast<int>(type)]; }
+
+// Standard algebraic notation, without check marks.
+std::string San(const Board& board, const Move& move) {
+  const Piece* piece = board.GetPiece(move.From());
+  PieceType type = piece->Type();
+  int diff = move.To().X() - move.From().X();
+  if (type == PieceType::kKing && std::abs(diff) == 2) {
+    return diff > 0 ? "O-O" : "O-O-O";
+  }
+  std::string san;
+  bool capture = board.GetPiece(move.To()) != nullptr;
+  if (type == PieceType::kPawn) {
+    if (capture) {
+      san += move.From().String()[0];
+    }
+  } else {
+    san += PieceLetter(type);
+    bool ambiguous = false;
+    bool same_file = false;
+    bool same_rank = false;
+    std::vector<Move> moves;
+    board.GenerateMoves(kAllMoves, moves);
+    for (const Move& other : moves) {
+      if (other.To() == move.To() && !(other.From() == move.From()) &&
+          board.GetPiece(other.From())->Type() == type) {
+        ambiguous = true;
+        same_file |= other.From().X() == move.From().X();
+        same_rank |= other.From().Y() == move.From().Y();
+      }
+    }
+    if (ambiguous && (!same_file || same_rank)) {
+      san += move.From().String()[0];
+    }
+    if (ambiguous && same_file) {
+      san += move.From().String()[1];
+    }
+  }
+  if (capture) {
+    san += 'x';
+  }
+  san += move.To().String();
+  if (type == PieceType::kPawn && (move.To().Y() == 0 || move.To().Y() == 7)) {
+    san += '=';
+    san += PieceLetter(move.PromoteTo() == kBishop  ? PieceType::kBishop
+                       : move.PromoteTo() == kKnight ? PieceType::kKnight
+                       : move.PromoteTo() == kRook   ? PieceType::kRook
+                                                     : PieceType::kQueen);
+  }
+  return san;
+}
+
+// Check marks and annotations are ignored, and so is the "=" of promotions.
+std::string Normalize(std::string move) {
+  move.erase(std::remove_if(move.begin(), move.end(),
+                            [](char c) {
+                              return c == '+' || c == '#' || c == '!' ||
+                                     c == '?' || c == '=';
+                            }),
+             move.end());
+  std::replace(move.begin(), move.end(), '0', 'O');
+  return move;
+}
+
+bool Matches(const Board& board, const Move& move,
+             const std::vector<std::string>& answers) {
+  std::string san = Normalize(San(board, move));
+  std::string xboard = move.XboardString();
+  return std::any_of(answers.begin(), answers.end(),
+                     [&](const std::string& answer) {
+                       std::string normalized = Normalize(answer);
+                       return normalized == san || answer == xboard;
+                     });
+}
+
+EpdResult Solve(const EpdEntry& entry, const Board& board,
+                const EpdOptions& options, AnyUtility& utility) {
+  Cache cache;
+  SearchLimits limits;
+  limits.max_nodes = options.max_nodes;
+  auto start = std::chrono::steady_clock::now();
+  if (options.move_time.count() > 0) {
+    limits.deadline = start + options.move_time;
+  }
+  Color color = board.CurrentPlayer();
+  EpdResult result;
+  std::optional<double> solved_since;
+  for (int depth = 0; depth < kMaxDepth; ++depth) {
+    auto moves = ComputeUtility(board, color, depth, utility, cache, limits);
+    if (limits.stopped || moves.empty()) {
+      break;
+    }
+    const Move& best =
+        *std::max_element(moves.begin(), moves.end(), ColorfulCompare(color));
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    result.best_move = San(board, best);
+    result.solved = (entry.best_moves.empty() ||
+                     Matches(board, best, entry.best_moves)) &&
+                    !Matches(board, best, entry.avoid_moves);
+    if (!result.solved) {
+      solved_since.reset();
+    } else if (!solved_since.has_value()) {
+      solved_since = elapsed.count();
+    }
+    // Deeper searches find the same mate.
+    if (IsMateScore(best.Utility())) {
+      break;
+    }
+  }
+  result.seconds_to_solution = solved_since.value_or(0);
+  result.nodes = limits.nodes;
+  return result;
+}
+
+}  // namespace
+
+bool RunEpd(const std::string& path, const EpdOptions& options,
+            const AnyUtility& utility, std::ostream& out) {
+  std::ifstream file(path);
+  if (!file) {
+    return false;
+  }
+  std::vector<EpdEntry> entries;
+  std::vector<Board> boards;
+  std::string line;
+  for (int number = 1; std::getline(file, line); ++number) {
+    if (line.find_first_not_of(" \t\r") == std::string::npos) {
+      continue;
+    }
+    auto entry = ParseEpdLine(line, number);
+    auto board = entry.has_value() ? Board::FromFen(entry->fen) : std::nullopt;
+    if (!board.has_value()) {
+      out << "# Skipping invalid line " << number << std::endl;
+      continue;
+    }
+    entries.push_back(*entry);
+    boards.push_back(std::move(*board));
+  }
+
+  std::vector<EpdResult> results(entries.size());
+  std::atomic<size_t> next(0);
+  std::mutex out_mutex;
+  auto start = std::chrono::steady_clock::now();
+  auto worker = [&]() {
+    AnyUtility own_utility = utility;
+    for (size_t i = next++; i < entries.size(); i = next++) {
+      results[i] = Solve(entries[i], boards[i], options, own_utility);
+      std::lock_guard<std::mutex> lock(out_mutex);
+      out << entries[i].id << " " << (results[i].solved ? "solved" : "failed")
+          << " " << results[i].best_move << " " << results[i].nodes
+          << " nodes" << std::endl;
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int i = 0; i < std::max(1, options.threads); ++i) {
+    threads.emplace_back(worker);
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  int solved = 0;
+  double seconds_to_solution = 0;
+  uint64_t nodes = 0;
+  for (const EpdResult& result : results) {
+    solved += result.solved;
+    seconds_to_solution += result.solved ? result.seconds_to_solution : 0;
+    nodes += result.nodes;
+  }
+  out << std::fixed << std::setprecision(3);
+  out << "Solved " << solved << "/" << results.size() << std::endl;
+  out << "Average time to solution: "
+      << (solved > 0 ? seconds_to_solution / solved : 0) << "s" << std::endl;
+  out << "Nodes: " << nodes << ", nodes/s: "
+      << static_cast<uint64_t>(nodes / std::max(elapsed.count(), 1e-9))
+      << std::endl;
+  return true;
+}
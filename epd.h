@@ -0,0 +1,28 @@
+#ifndef EPD_H_
+#define EPD_H_
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include "engine.h"
+
+struct EpdOptions {
+  // Zero means no limit, but at least one of them must be set.
+  uint64_t max_nodes = 0;
+  std::chrono::milliseconds move_time{1000};
+  int threads = 1;
+};
+
+// Runs the test suite in the EPD file at `path`. Each position is searched
+// one ply deeper at a time until its limits run out, and it's solved if the
+// last complete search picks one of its best moves (bm) and none of the
+// moves to avoid (am). Moves are matched in SAN or xboard notation.
+// Positions are searched concurrently, each with its own board, cache and
+// copy of `utility`. Prints a line per position and a summary to `out`, and
+// returns false if the file can't be read.
+bool RunEpd(const std::string& path, const EpdOptions& options,
+            const AnyUtility& utility, std::ostream& out = std::cout);
+
+#endif  // EPD_H_
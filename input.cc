@@ -0,0 +1,42 @@
+#include "input.h"
+
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+
+void MessageQueue::Push(Message message) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    messages_.push_back(std::move(message));
+  }
+  pushed_.notify_one();
+}
+
+Message MessageQueue::Pop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  pushed_.wait(lock, [this]() { return !messages_.empty(); });
+  Message message = std::move(messages_.front());
+  messages_.pop_front();
+  return message;
+}
+
+void StartReadingInput(MessageQueue& queue) {
+  // Detached, since nothing can interrupt a blocking read. It stops reading
+  // at "quit", so it doesn't outlive the queue.
+  std::thread([&queue]() {
+    std::string line;
+    while (std::getline(std::cin, line)) {
+      if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+      }
+      queue.Push({Message::kInput, line, 0, std::nullopt});
+      if (line == "quit") {
+        return;
+      }
+    }
+    queue.Push({Message::kInput, "quit", 0, std::nullopt});
+  }).detach();
+}
@@ -0,0 +1,41 @@
+#ifndef INPUT_H_
+#define INPUT_H_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "move.h"
+
+// What the protocol loops wait on: lines from the GUI and the results of
+// their own searches, in the order they happen.
+struct Message {
+  enum Type { kInput, kSearchDone };
+
+  Type type;
+  std::string line;
+  // Which search finished, and the move it found.
+  int search = 0;
+  std::optional<Move> move;
+};
+
+class MessageQueue {
+ public:
+  void Push(Message message);
+  // Waits for the next message.
+  Message Pop();
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable pushed_;
+  std::deque<Message> messages_;
+};
+
+// Reads standard input on a thread of its own, so that commands get through
+// while the engine searches. Each line is pushed to `queue`, up to and
+// including "quit", which is also pushed when the input ends.
+void StartReadingInput(MessageQueue& queue);
+
+#endif  // INPUT_H_
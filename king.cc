@@ -51,6 +51,11 @@ void GetCastlingMoves(const Board& board, Position from, unused Color color,
 
 }  // namespace
 
+King::King(Color color) : King(color, false) {}
+
+King::King(Color color, bool moved)
+    : Piece(color, PieceType::kKing), moved_(moved) {}
+
 std::string King::String() const { return GetColor() == kWhite ? "♔" : "♚"; }
 
 std::vector<Position> King::GetMoves(const Board& board, Position from) const {
@@ -11,7 +11,8 @@
 
 class King : public Piece {
  public:
-  using Piece::Piece;
+  explicit King(Color color);
+  King(Color color, bool moved);
 
   std::string String() const override;
 
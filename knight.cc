@@ -8,6 +8,8 @@
 #include "piece.h"
 #include "position.h"
 
+Knight::Knight(Color color) : Piece(color, PieceType::kKnight) {}
+
 std::string Knight::String() const { return GetColor() == kWhite ? "♘" : "♞"; }
 
 std::vector<Position> Knight::GetMoves(const Board& board,
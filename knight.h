@@ -10,7 +10,7 @@
 
 class Knight : public Piece {
  public:
-  using Piece::Piece;
+  explicit Knight(Color color);
 
   std::string String() const override;
 
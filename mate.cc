@@ -0,0 +1,252 @@
+#include "mate.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "board.h"
+#include "engine.h"
+#include "move.h"
+#include "movegen.h"
+
+namespace {
+
+typedef uint64_t ProofNumber;
+
+// Larger than any sum of proof numbers the search gets to.
+const ProofNumber kInfiniteProof = ProofNumber(1) << 40;
+
+// Proof numbers from the side to move, as in negamax: `phi` is how many more
+// positions at least must be settled to show that it gets its way (the
+// attacker mates, the defender escapes), `delta` how many to show that it
+// doesn't. The attacker's phi is the proof number, the defender's the
+// disproof number.
+struct ProofNumbers {
+  ProofNumber phi;
+  ProofNumber delta;
+};
+
+const ProofNumbers kUnknown = {1, 1};
+const ProofNumbers kGetsItsWay = {0, kInfiniteProof};
+const ProofNumbers kFails = {kInfiniteProof, 0};
+
+struct MateState {
+  explicit MateState(SearchLimits& limits) : limits(limits) {}
+
+  SearchLimits& limits;
+  // By position and plies left. The plies only ever go down along a line,
+  // so no line can come back to a position it has been through.
+  std::unordered_map<size_t, ProofNumbers> table;
+};
+
+size_t Key(const Board& board, int plies) {
+  return std::hash<std::string>{}(board.Hash() + "/" + std::to_string(plies));
+}
+
+bool Stop(SearchLimits& limits) {
+  ++limits.nodes;
+  if (limits.max_nodes != 0 && limits.nodes > limits.max_nodes) {
+    limits.stopped = true;
+  } else if (limits.stop != nullptr &&
+             limits.stop->load(std::memory_order_relaxed)) {
+    limits.stopped = true;
+  } else if (limits.deadline.has_value() && limits.nodes % 1024 == 0) {
+    limits.stopped = std::chrono::steady_clock::now() >= *limits.deadline;
+  }
+  return limits.stopped;
+}
+
+ProofNumbers Lookup(const MateState& state, size_t key,
+                    const ProofNumbers& initial) {
+  auto entry = state.table.find(key);
+  return entry == state.table.end() ? initial : entry->second;
+}
+
+// Searches `board`, with `plies` left and the attacker to move when they're
+// odd, until its phi reaches `phi_threshold` or its delta `delta_threshold`.
+ProofNumbers Search(const Board& board, int plies,
+                    ProofNumber phi_threshold, ProofNumber delta_threshold,
+                    MateState& state) {
+  if (Stop(state.limits)) {
+    return kUnknown;
+  }
+  bool attacker = plies % 2 == 1;
+  std::vector<Move> moves;
+  board.GenerateMoves(kAllMoves, moves);
+  ProofNumbers result;
+  if (moves.empty()) {
+    // Mated or stalemated, which only the defender getting mated is good for.
+    bool mated = board.IsCheck(board.CurrentPlayer());
+    result = attacker || mated ? kFails : kGetsItsWay;
+  } else if (plies == 0) {
+    result = kGetsItsWay;
+  } else {
+    std::vector<Board> children;
+    std::vector<size_t> keys;
+    std::vector<ProofNumbers> initial;
+    children.reserve(moves.size());
+    for (const Move& move : moves) {
+      Board& child = children.emplace_back(board);
+      child.DoMove(move);
+      child.NewTurn();
+      keys.push_back(Key(child, plies - 1));
+      // Only checks can mate on the last move.
+      bool escaped = plies == 1 && !child.IsCheck(child.CurrentPlayer());
+      initial.push_back(escaped ? kGetsItsWay : kUnknown);
+    }
+    while (true) {
+      result = {kInfiniteProof, 0};
+      size_t best = 0;
+      ProofNumbers best_numbers = kUnknown;
+      ProofNumber second_delta = kInfiniteProof;
+      for (size_t i = 0; i < children.size(); ++i) {
+        ProofNumbers numbers = Lookup(state, keys[i], initial[i]);
+        result.delta = std::min(result.delta + numbers.phi, kInfiniteProof);
+        if (numbers.delta < result.phi) {
+          second_delta = result.phi;
+          result.phi = numbers.delta;
+          best = i;
+          best_numbers = numbers;
+        } else if (numbers.delta < second_delta) {
+          second_delta = numbers.delta;
+        }
+      }
+      if (result.phi >= phi_threshold || result.delta >= delta_threshold) {
+        break;
+      }
+      Search(children[best], plies - 1,
+             delta_threshold + best_numbers.phi - result.delta,
+             std::min(phi_threshold, second_delta + 1), state);
+      if (state.limits.stopped) {
+        return kUnknown;
+      }
+    }
+  }
+  state.table[Key(board, plies)] = result;
+  return result;
+}
+
+// The fewest plies, odd and at most `plies`, in which the attacker, to move
+// on `board`, mates. More than `plies` if it doesn't, or if `limits` stop the
+// search.
+int ShortestMate(const Board& board, int plies, MateState& state) {
+  int shortest = 1;
+  while (shortest <= plies &&
+         Search(board, shortest, kInfiniteProof, kInfiniteProof, state).phi !=
+             0 &&
+         !state.limits.stopped) {
+    shortest += 2;
+  }
+  return state.limits.stopped ? plies + 1 : shortest;
+}
+
+// Follows the proof of a mate in `plies` and no fewer, with the defender
+// putting it off as long as it can at every move, so that the line is as
+// long as the mate.
+std::vector<Move> MatingLine(const Board& board, int plies,
+                             MateState& state) {
+  std::vector<Move> line;
+  Board position = board;
+  for (; plies > 0; --plies) {
+    bool attacker = plies % 2 == 1;
+    std::vector<Move> moves;
+    position.GenerateMoves(kAllMoves, moves);
+    std::optional<Move> next;
+    int longest = -1;
+    for (const Move& move : moves) {
+      Board child = position;
+      child.DoMove(move);
+      child.NewTurn();
+      if (attacker) {
+        if (Lookup(state, Key(child, plies - 1), kUnknown).delta == 0) {
+          next = move;
+          break;
+        }
+      } else if (int shortest = ShortestMate(child, plies - 1, state);
+                 shortest > longest) {
+        longest = shortest;
+        next = move;
+      }
+    }
+    if (!next.has_value()) {
+      break;
+    }
+    line.push_back(*next);
+    position.DoMove(*next);
+    position.NewTurn();
+  }
+  return line;
+}
+
+}  // namespace
+
+std::optional<std::vector<Move>> FindMate(const Board& board, int moves,
+                                          SearchLimits& limits) {
+  MateState state(limits);
+  for (int n = 1; n <= moves; ++n) {
+    int plies = 2 * n - 1;
+    ProofNumbers numbers =
+        Search(board, plies, kInfiniteProof, kInfiniteProof, state);
+    if (limits.stopped) {
+      return {};
+    }
+    if (numbers.phi == 0) {
+      return MatingLine(board, plies, state);
+    }
+  }
+  return {};
+}
+
+void RunMate(int moves, uint64_t max_nodes, std::chrono::milliseconds move_time,
+             std::istream& in, std::ostream& out) {
+  std::string line;
+  int number = 0;
+  int found = 0;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string fen, field;
+    for (int i = 0; i < 4 && fields >> field; ++i) {
+      fen += (i > 0 ? " " : "") + field;
+    }
+    if (fen.empty()) {
+      continue;
+    }
+    ++number;
+    auto board = Board::FromFen(fen);
+    if (!board.has_value()) {
+      out << number << ": invalid position" << std::endl;
+      continue;
+    }
+    SearchLimits limits;
+    limits.max_nodes = max_nodes;
+    auto start = std::chrono::steady_clock::now();
+    if (move_time.count() > 0) {
+      limits.deadline = start + move_time;
+    }
+    auto mate = FindMate(*board, moves, limits);
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    out << number << ": ";
+    if (mate.has_value()) {
+      ++found;
+      out << "mate in " << (mate->size() + 1) / 2 << ":";
+      for (const Move& move : *mate) {
+        out << " " << move.XboardString();
+      }
+    } else if (limits.stopped) {
+      out << "unknown";
+    } else {
+      out << "no mate in " << moves;
+    }
+    out << std::fixed << std::setprecision(3) << " (" << limits.nodes
+        << " nodes, " << elapsed.count() << "s)" << std::endl;
+  }
+  out << "Mates found: " << found << "/" << number << std::endl;
+}
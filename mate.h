@@ -0,0 +1,35 @@
+#ifndef MATE_H_
+#define MATE_H_
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <vector>
+
+#include "board.h"
+#include "engine.h"
+#include "move.h"
+
+const int kMateMoves = 5;
+
+// Looks for a forced mate by the side to move in at most `moves` of its
+// moves, with depth-first proof-number search. Unlike ComputeUtility it
+// doesn't score positions, it only asks whether the mate exists, so it
+// follows whichever lines are closest to settling that, however deep, and
+// gives up on the others as soon as one defence holds. Shorter mates are
+// tried first. Returns the mate, the attacker's and the defender's moves
+// alternating, or nullopt if there's none or `limits` stopped the search
+// first. `limits.max_nodes`, `deadline` and `stop` are honoured, the rest
+// is ignored.
+std::optional<std::vector<Move>> FindMate(const Board& board, int moves,
+                                          SearchLimits& limits);
+
+// Reads positions from `in`, one per line in FEN or EPD (only the first four
+// fields are used), and prints to `out` the shortest mate in at most `moves`
+// found in each, with `max_nodes` and `move_time` per position. Zero means
+// no limit.
+void RunMate(int moves, uint64_t max_nodes, std::chrono::milliseconds move_time,
+             std::istream& in = std::cin, std::ostream& out = std::cout);
+
+#endif  // MATE_H_
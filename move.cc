@@ -6,6 +6,7 @@
 #include <memory>
 
 #include "position.h"
+#include "score.h"
 
 std::optional<Move> Move::FromString(std::string from, std::string to) {
   auto from_position = Position::FromString(from);
@@ -47,7 +48,15 @@ std::optional<Move> Move::FromXboardString(std::string move) {
   return Move(*from_position, *to_position, promotion);
 }
 
-Move::Move(Position from, Position to, std::optional<Promotion> promotion) : from_(from), to_(to), promotion_(promotion), utility_(0.0) {}
+Move Move::Unpack(uint16_t packed) {
+  std::optional<Promotion> promotion;
+  if (packed >> 12) {
+    promotion = static_cast<Promotion>((packed >> 12) - 1);
+  }
+  return Move({packed & 7, (packed >> 3) & 7}, {(packed >> 6) & 7, (packed >> 9) & 7}, promotion);
+}
+
+Move::Move(Position from, Position to, std::optional<Promotion> promotion) : from_(from), to_(to), promotion_(promotion), utility_(0) {}
 
 bool Move::operator==(const Move& move) const {
   return From() == move.From() && To() == move.To();
@@ -61,8 +70,13 @@ std::string Move::String() const { return from_.String() + " " + to_.String(); }
 
 std::string Move::XboardString() const { return from_.String() + to_.String(); }
 
-void Move::SetUtility(double utility) { utility_ = utility; }
+void Move::SetUtility(Score utility) { utility_ = utility; }
+
+Score Move::Utility() const { return utility_; }
 
-double Move::Utility() const { return utility_; }
+std::optional<Promotion> Move::PromoteTo() const { return promotion_; };
 
-std::optional<Promotion> Move::PromoteTo() const { return promotion_; };
\ No newline at end of file
+uint16_t Move::Pack() const {
+  int promotion = promotion_.has_value() ? *promotion_ + 1 : 0;
+  return from_.X() | from_.Y() << 3 | to_.X() << 6 | to_.Y() << 9 | promotion << 12;
+}
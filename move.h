@@ -1,11 +1,13 @@
 #ifndef MOVE_H_
 #define MOVE_H_
 
+#include <cstdint>
 #include <optional>
 #include <string>
 #include <memory>
 
 #include "position.h"
+#include "score.h"
 
 enum Promotion {
   kBishop,
@@ -14,10 +16,14 @@ enum Promotion {
   kRook,
 };
 
+// Packed moves never have from == to, so zero can stand for "no move".
+const uint16_t kNoMove = 0;
+
 class Move {
  public:
   static std::optional<Move> FromString(std::string from, std::string to);
   static std::optional<Move> FromXboardString(std::string move);
+  static Move Unpack(uint16_t packed);
 
   Move(Position from, Position to, std::optional<Promotion> promotion);
   bool operator==(const Move& move) const;
@@ -28,16 +34,19 @@ class Move {
   std::string String() const;
   std::string XboardString() const;
 
-  void SetUtility(double utility);
-  double Utility() const;
+  void SetUtility(Score utility);
+  Score Utility() const;
 
   std::optional<Promotion> PromoteTo() const;
 
+  // Unlike operator==, packing tells apart promotions to different pieces.
+  uint16_t Pack() const;
+
  private:
   Position from_;
   Position to_;
   std::optional<Promotion> promotion_;
-  double utility_;
+  Score utility_;
 };
 
 #endif  // MOVE_H_
@@ -0,0 +1,417 @@
+#include "movegen.h"
+
+#include <optional>
+#include <vector>
+
+#include "board.h"
+#include "color.h"
+#include "king.h"
+#include "move.h"
+#include "piece.h"
+#include "position.h"
+#include "rook.h"
+
+namespace {
+
+constexpr int kKnightSteps[8][2] = {
+  {-1, -2}, {-1, 2}, {1, -2}, {1, 2}, {-2, -1}, {-2, 1}, {2, -1}, {2, 1},
+};
+constexpr int kKingSteps[8][2] = {
+  {-1, -1}, {-1, 0}, {-1, 1}, {0, -1}, {0, 1}, {1, -1}, {1, 0}, {1, 1},
+};
+constexpr int kBishopDirections[4][2] = {{-1, -1}, {-1, 1}, {1, -1}, {1, 1}};
+constexpr int kRookDirections[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+
+bool OnBoard(int x, int y) { return x >= 0 && x <= 7 && y >= 0 && y <= 7; }
+
+template <Color Us>
+constexpr int Forward() { return Us == kWhite ? 1 : -1; }
+
+// Returns true when the step landed on an empty square, so sliders go on.
+template <Color Us, MoveGenMode Mode>
+bool AddStep(const Board& board, Position from, int x, int y,
+             std::vector<Move>& moves) {
+  int to_x = from.X() + x;
+  int to_y = from.Y() + y;
+  if (!OnBoard(to_x, to_y)) {
+    return false;
+  }
+  Position to(to_x, to_y);
+  const Piece* target = board.GetPiece(to);
+  if (target == nullptr) {
+    if constexpr (Mode != kCaptureMoves) {
+      moves.emplace_back(from, to, std::nullopt);
+    }
+    return true;
+  }
+  if constexpr (Mode != kQuietMoves) {
+    if (target->GetColor() != Us) {
+      moves.emplace_back(from, to, std::nullopt);
+    }
+  }
+  return false;
+}
+
+template <Color Us, MoveGenMode Mode, size_t N>
+void AddSteps(const Board& board, Position from, const int (&steps)[N][2],
+              std::vector<Move>& moves) {
+  for (const auto& step : steps) {
+    AddStep<Us, Mode>(board, from, step[0], step[1], moves);
+  }
+}
+
+template <Color Us, MoveGenMode Mode, size_t N>
+void AddSlides(const Board& board, Position from,
+               const int (&directions)[N][2], std::vector<Move>& moves) {
+  for (const auto& direction : directions) {
+    for (int size = 1; AddStep<Us, Mode>(board, from, size * direction[0],
+                                         size * direction[1], moves);
+         ++size) {
+    }
+  }
+}
+
+template <Color Us, MoveGenMode Mode>
+void AddPawnMove(Position from, Position to, bool capture,
+                 std::vector<Move>& moves) {
+  if (to.Y() == 0 || to.Y() == 7) {
+    if constexpr (Mode != kQuietMoves) {
+      moves.emplace_back(from, to, kBishop);
+      moves.emplace_back(from, to, kKnight);
+      moves.emplace_back(from, to, kQueen);
+      moves.emplace_back(from, to, kRook);
+    }
+  } else if (capture ? Mode != kQuietMoves : Mode != kCaptureMoves) {
+    moves.emplace_back(from, to, std::nullopt);
+  }
+}
+
+template <Color Us, MoveGenMode Mode>
+void AddPawnMoves(const Board& board, Position from,
+                  std::vector<Move>& moves) {
+  constexpr int kDoublePushRow = Us == kWhite ? 1 : 6;
+  int y = from.Y() + Forward<Us>();
+  if (y < 0 || y > 7) {
+    return;
+  }
+  Position next(from.X(), y);
+  if (board.GetPiece(next) == nullptr) {
+    AddPawnMove<Us, Mode>(from, next, false, moves);
+    if constexpr (Mode != kCaptureMoves) {
+      if (from.Y() == kDoublePushRow) {
+        Position two(from.X(), y + Forward<Us>());
+        if (board.GetPiece(two) == nullptr) {
+          moves.emplace_back(from, two, std::nullopt);
+        }
+      }
+    }
+  }
+  for (int side = -1; side <= 1; side += 2) {
+    int x = from.X() + side;
+    if (x < 0 || x > 7) {
+      continue;
+    }
+    Position to(x, y);
+    const Piece* target = board.GetPiece(to);
+    if (target == nullptr || target->GetColor() == Us) {
+      continue;
+    }
+    AddPawnMove<Us, Mode>(from, to, true, moves);
+  }
+}
+
+// TODO: Check if the king is in check in any position in the way.
+template <Color Us, MoveGenMode Mode>
+void AddCastlingMoves(const Board& board, Position from,
+                      std::vector<Move>& moves) {
+  if constexpr (Mode == kCaptureMoves) {
+    return;
+  }
+  for (int direction = -1; direction <= 1; direction += 2) {
+    for (int x = from.X() + direction; x >= 0 && x <= 7; x += direction) {
+      const Piece* piece = board.GetPiece({x, from.Y()});
+      if (piece == nullptr) {
+        continue;
+      }
+      if (piece->Type() == PieceType::kRook &&
+          !static_cast<const Rook*>(piece)->Moved()) {
+        moves.emplace_back(from, *from.Move(direction * 2, 0), std::nullopt);
+      }
+      break;
+    }
+  }
+}
+
+// Calls `on_attacker(x, y)` for every piece of the other side attacking the
+// square, stopping early once it returns true. `piece_at` lets the legality
+// check look at the board as if a move had already been made, without
+// touching the board itself.
+template <Color Us, typename PieceAt, typename OnAttacker>
+bool ForEachAttacker(PieceAt piece_at, int x, int y, OnAttacker on_attacker) {
+  constexpr Color kThem = Us == kWhite ? kBlack : kWhite;
+  auto is = [](const Piece* piece, PieceType type) {
+    return piece->GetColor() == kThem && piece->Type() == type;
+  };
+  for (const auto& direction : kBishopDirections) {
+    for (int size = 1; true; ++size) {
+      int to_x = x + size * direction[0];
+      int to_y = y + size * direction[1];
+      if (!OnBoard(to_x, to_y)) {
+        break;
+      }
+      const Piece* piece = piece_at(to_x, to_y);
+      if (piece == nullptr) {
+        continue;
+      }
+      if ((is(piece, PieceType::kBishop) || is(piece, PieceType::kQueen)) &&
+          on_attacker(to_x, to_y)) {
+        return true;
+      }
+      break;
+    }
+  }
+  for (const auto& direction : kRookDirections) {
+    for (int size = 1; true; ++size) {
+      int to_x = x + size * direction[0];
+      int to_y = y + size * direction[1];
+      if (!OnBoard(to_x, to_y)) {
+        break;
+      }
+      const Piece* piece = piece_at(to_x, to_y);
+      if (piece == nullptr) {
+        continue;
+      }
+      if ((is(piece, PieceType::kRook) || is(piece, PieceType::kQueen)) &&
+          on_attacker(to_x, to_y)) {
+        return true;
+      }
+      break;
+    }
+  }
+  for (const auto& step : kKnightSteps) {
+    int to_x = x + step[0];
+    int to_y = y + step[1];
+    if (!OnBoard(to_x, to_y)) {
+      continue;
+    }
+    const Piece* piece = piece_at(to_x, to_y);
+    if (piece != nullptr && is(piece, PieceType::kKnight) &&
+        on_attacker(to_x, to_y)) {
+      return true;
+    }
+  }
+  for (int side = -1; side <= 1; side += 2) {
+    int to_x = x + side;
+    int to_y = y + Forward<Us>();
+    if (!OnBoard(to_x, to_y)) {
+      continue;
+    }
+    const Piece* piece = piece_at(to_x, to_y);
+    if (piece != nullptr && is(piece, PieceType::kPawn) &&
+        on_attacker(to_x, to_y)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+template <Color Us, typename PieceAt>
+bool IsAttacked(PieceAt piece_at, int x, int y) {
+  return ForEachAttacker<Us>(piece_at, x, y, [](int, int) { return true; });
+}
+
+template <Color Us>
+bool IsLegalWithKing(const Board& board, const Move& move,
+                     std::optional<Position> king) {
+  if (!king.has_value()) {
+    return true;
+  }
+  Position from = move.From();
+  Position to = move.To();
+  const Piece* mover = board.GetPiece(from);
+  if (mover->Type() == PieceType::kKing) {
+    king = to;
+  }
+  auto piece_at = [&](int x, int y) -> const Piece* {
+    if (x == to.X() && y == to.Y()) {
+      return mover;
+    }
+    if (x == from.X() && y == from.Y()) {
+      return nullptr;
+    }
+    return board.GetPiece({x, y});
+  };
+  return !IsAttacked<Us>(piece_at, king->X(), king->Y());
+}
+
+// Squares a non-king move may land on to get out of a check by `checker`:
+// the checker itself, or anything in between it and a sliding attack.
+bool BlocksCheck(Position king, Position checker, const Piece* checker_piece,
+                 Position to) {
+  if (to == checker) {
+    return true;
+  }
+  PieceType type = checker_piece->Type();
+  if (type != PieceType::kBishop && type != PieceType::kRook &&
+      type != PieceType::kQueen) {
+    return false;
+  }
+  int dx = (checker.X() > king.X()) - (checker.X() < king.X());
+  int dy = (checker.Y() > king.Y()) - (checker.Y() < king.Y());
+  for (int x = king.X() + dx, y = king.Y() + dy;
+       x != checker.X() || y != checker.Y(); x += dx, y += dy) {
+    if (to.X() == x && to.Y() == y) {
+      return true;
+    }
+  }
+  return false;
+}
+
+template <Color Us>
+void KeepEvasions(const Board& board, size_t first, std::vector<Move>& moves) {
+  auto king = board.FindKing(Us);
+  if (!king.has_value()) {
+    return;
+  }
+  auto piece_at = [&](int x, int y) { return board.GetPiece({x, y}); };
+  std::optional<Position> checker;
+  int checkers = 0;
+  ForEachAttacker<Us>(piece_at, king->X(), king->Y(), [&](int x, int y) {
+    checker = Position(x, y);
+    return ++checkers > 1;
+  });
+  if (checkers == 0) {
+    return;
+  }
+  size_t kept = first;
+  for (size_t i = first; i < moves.size(); ++i) {
+    const Move& move = moves[i];
+    bool keep = move.From() == *king ||
+                (checkers == 1 && BlocksCheck(*king, *checker,
+                                              board.GetPiece(*checker),
+                                              move.To()));
+    if (keep) {
+      moves[kept++] = move;
+    }
+  }
+  moves.erase(moves.begin() + kept, moves.end());
+}
+
+template <Color Us, MoveGenMode Mode>
+void AddPieceMoves(const Board& board, Position from, const Piece* piece,
+                   std::vector<Move>& moves) {
+  switch (piece->Type()) {
+    case PieceType::kPawn:
+      AddPawnMoves<Us, Mode>(board, from, moves);
+      break;
+    case PieceType::kKnight:
+      AddSteps<Us, Mode>(board, from, kKnightSteps, moves);
+      break;
+    case PieceType::kBishop:
+      AddSlides<Us, Mode>(board, from, kBishopDirections, moves);
+      break;
+    case PieceType::kRook:
+      AddSlides<Us, Mode>(board, from, kRookDirections, moves);
+      break;
+    case PieceType::kQueen:
+      AddSlides<Us, Mode>(board, from, kBishopDirections, moves);
+      AddSlides<Us, Mode>(board, from, kRookDirections, moves);
+      break;
+    case PieceType::kKing:
+      AddSteps<Us, Mode>(board, from, kKingSteps, moves);
+      if (!static_cast<const King*>(piece)->Moved()) {
+        AddCastlingMoves<Us, Mode>(board, from, moves);
+      }
+      break;
+  }
+}
+
+}  // namespace
+
+template <Color Us, MoveGenMode Mode>
+void GeneratePseudoLegalMoves(const Board& board, std::vector<Move>& moves) {
+  constexpr MoveGenMode kMode = Mode == kEvasionMoves ? kAllMoves : Mode;
+  size_t first = moves.size();
+  for (int x = 0; x <= 7; ++x) {
+    for (int y = 0; y <= 7; ++y) {
+      Position from(x, y);
+      const Piece* piece = board.GetPiece(from);
+      if (piece == nullptr || piece->GetColor() != Us) {
+        continue;
+      }
+      AddPieceMoves<Us, kMode>(board, from, piece, moves);
+    }
+  }
+  if constexpr (Mode == kEvasionMoves) {
+    KeepEvasions<Us>(board, first, moves);
+  }
+}
+
+template <Color Us, MoveGenMode Mode>
+void GenerateLegalMoves(const Board& board, std::vector<Move>& moves) {
+  size_t first = moves.size();
+  GeneratePseudoLegalMoves<Us, Mode>(board, moves);
+  auto king = board.FindKing(Us);
+  size_t kept = first;
+  for (size_t i = first; i < moves.size(); ++i) {
+    if (IsLegalWithKing<Us>(board, moves[i], king)) {
+      moves[kept++] = moves[i];
+    }
+  }
+  moves.erase(moves.begin() + kept, moves.end());
+}
+
+template <Color Us>
+bool IsInCheck(const Board& board) {
+  auto king = board.FindKing(Us);
+  if (!king.has_value()) {
+    return false;
+  }
+  auto piece_at = [&](int x, int y) { return board.GetPiece({x, y}); };
+  return IsAttacked<Us>(piece_at, king->X(), king->Y());
+}
+
+template <Color Us>
+bool IsLegal(const Board& board, const Move& move) {
+  return IsLegalWithKing<Us>(board, move, board.FindKing(Us));
+}
+
+template <Color Us>
+bool IsPseudoLegal(const Board& board, const Move& move) {
+  const Piece* piece = board.GetPiece(move.From());
+  if (piece == nullptr || piece->GetColor() != Us) {
+    return false;
+  }
+  std::vector<Move> moves;
+  AddPieceMoves<Us, kAllMoves>(board, move.From(), piece, moves);
+  for (const Move& candidate : moves) {
+    if (candidate.Pack() == move.Pack()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+#define INSTANTIATE_MOVEGEN(color)                                          \
+  template void GeneratePseudoLegalMoves<color, kAllMoves>(                 \
+      const Board&, std::vector<Move>&);                                    \
+  template void GeneratePseudoLegalMoves<color, kCaptureMoves>(             \
+      const Board&, std::vector<Move>&);                                    \
+  template void GeneratePseudoLegalMoves<color, kQuietMoves>(               \
+      const Board&, std::vector<Move>&);                                    \
+  template void GeneratePseudoLegalMoves<color, kEvasionMoves>(             \
+      const Board&, std::vector<Move>&);                                    \
+  template void GenerateLegalMoves<color, kAllMoves>(const Board&,          \
+                                                     std::vector<Move>&);   \
+  template void GenerateLegalMoves<color, kCaptureMoves>(const Board&,      \
+                                                         std::vector<Move>&); \
+  template void GenerateLegalMoves<color, kQuietMoves>(const Board&,        \
+                                                       std::vector<Move>&); \
+  template void GenerateLegalMoves<color, kEvasionMoves>(const Board&,      \
+                                                         std::vector<Move>&); \
+  template bool IsInCheck<color>(const Board&);                             \
+  template bool IsLegal<color>(const Board&, const Move&);                   \
+  template bool IsPseudoLegal<color>(const Board&, const Move&);
+
+INSTANTIATE_MOVEGEN(kWhite)
+INSTANTIATE_MOVEGEN(kBlack)
@@ -0,0 +1,37 @@
+#ifndef MOVEGEN_H_
+#define MOVEGEN_H_
+
+#include <vector>
+
+#include "color.h"
+#include "move.h"
+#include "position.h"
+
+class Board;
+
+// Captures include every promotion, so kCaptureMoves and kQuietMoves split
+// kAllMoves in two. kEvasionMoves only makes sense while in check.
+enum MoveGenMode { kAllMoves, kCaptureMoves, kQuietMoves, kEvasionMoves };
+
+// Appends the moves of `Us` to `moves`, in the same order the per-piece
+// Piece::GetMoves implementations produce them.
+template <Color Us, MoveGenMode Mode>
+void GeneratePseudoLegalMoves(const Board& board, std::vector<Move>& moves);
+
+// Same as above, but drops the moves that leave our king in check.
+template <Color Us, MoveGenMode Mode>
+void GenerateLegalMoves(const Board& board, std::vector<Move>& moves);
+
+template <Color Us>
+bool IsInCheck(const Board& board);
+
+// Whether a pseudo-legal move of `Us` leaves its own king safe.
+template <Color Us>
+bool IsLegal(const Board& board, const Move& move);
+
+// Whether the move, e.g. one remembered from another position, could be
+// generated here. Only the moving piece's moves are generated.
+template <Color Us>
+bool IsPseudoLegal(const Board& board, const Move& move);
+
+#endif  // MOVEGEN_H_
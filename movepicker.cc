@@ -0,0 +1,161 @@
+#include "movepicker.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "board.h"
+#include "move.h"
+#include "movegen.h"
+#include "piece.h"
+#include "see.h"
+
+namespace {
+
+// Most valuable victim first, least valuable attacker breaking ties.
+// Promotions without a capture count as capturing nothing.
+int CaptureOrder(const Board& board, const Move& move) {
+  const Piece* victim = board.GetPiece(move.To());
+  const Piece* attacker = board.GetPiece(move.From());
+  return (victim == nullptr ? 0 : 16 * victim->Value()) - attacker->Value();
+}
+
+// A capture can only lose material if the victim is worth less than the
+// piece taking it, so the exchange is only played out in that case.
+bool IsLosingCapture(const Board& board, const Move& move) {
+  const Piece* victim = board.GetPiece(move.To());
+  int victim_value = victim == nullptr ? 0 : victim->Value();
+  if (victim_value >= board.GetPiece(move.From())->Value()) {
+    return false;
+  }
+  return StaticExchange(board, move) < 0;
+}
+
+void SortCaptures(const Board& board, std::vector<Move>& moves) {
+  std::stable_sort(moves.begin(), moves.end(),
+                   [&board](const Move& a, const Move& b) {
+                     return CaptureOrder(board, a) > CaptureOrder(board, b);
+                   });
+}
+
+}  // namespace
+
+MovePicker::MovePicker(const Board& board, uint16_t cache_move,
+                       const std::array<uint16_t, 2>& killers)
+    : board_(board),
+      cache_move_(cache_move),
+      killers_(killers),
+      in_check_(board.IsCheck(board.CurrentPlayer())),
+      quiescence_(false),
+      stage_(kCacheMove),
+      index_(0) {}
+
+MovePicker::MovePicker(const Board& board)
+    : board_(board),
+      cache_move_(kNoMove),
+      killers_({kNoMove, kNoMove}),
+      in_check_(false),
+      quiescence_(true),
+      stage_(kGenerateCaptures),
+      index_(0) {}
+
+bool MovePicker::AlreadyPicked(const Move& move) const {
+  uint16_t packed = move.Pack();
+  if (packed == cache_move_) {
+    return true;
+  }
+  if (stage_ == kQuiets) {
+    return packed == killers_[0] || packed == killers_[1];
+  }
+  return false;
+}
+
+std::optional<Move> MovePicker::Next() {
+  while (true) {
+    switch (stage_) {
+      case kCacheMove:
+        stage_ = in_check_ ? kGenerateEvasions : kGenerateCaptures;
+        if (cache_move_ != kNoMove) {
+          Move move = Move::Unpack(cache_move_);
+          if (board_.IsLegalMove(move)) {
+            return move;
+          }
+          cache_move_ = kNoMove;
+        }
+        break;
+      case kGenerateCaptures:
+        board_.GenerateMoves(kCaptureMoves, moves_);
+        SortCaptures(board_, moves_);
+        index_ = 0;
+        stage_ = kCaptures;
+        break;
+      case kCaptures:
+        while (index_ < moves_.size()) {
+          const Move& move = moves_[index_++];
+          if (AlreadyPicked(move)) {
+            continue;
+          }
+          if (IsLosingCapture(board_, move)) {
+            if (!quiescence_) {
+              bad_captures_.push_back(move);
+            }
+            continue;
+          }
+          return move;
+        }
+        stage_ = quiescence_ ? kDone : kKillers;
+        index_ = 0;
+        break;
+      case kQuiets:
+      case kEvasions:
+        while (index_ < moves_.size()) {
+          const Move& move = moves_[index_++];
+          if (!AlreadyPicked(move)) {
+            return move;
+          }
+        }
+        stage_ = stage_ == kQuiets ? kBadCaptures : kDone;
+        index_ = 0;
+        break;
+      case kBadCaptures:
+        if (index_ < bad_captures_.size()) {
+          return bad_captures_[index_++];
+        }
+        stage_ = kDone;
+        break;
+      case kKillers:
+        while (index_ < killers_.size()) {
+          uint16_t killer = killers_[index_++];
+          if (killer == kNoMove || killer == cache_move_) {
+            continue;
+          }
+          Move move = Move::Unpack(killer);
+          if (board_.GetPiece(move.To()) == nullptr &&
+              !move.PromoteTo().has_value() && board_.IsLegalMove(move)) {
+            return move;
+          }
+        }
+        stage_ = kGenerateQuiets;
+        break;
+      case kGenerateQuiets:
+        moves_.clear();
+        board_.GenerateMoves(kQuietMoves, moves_);
+        index_ = 0;
+        stage_ = kQuiets;
+        break;
+      case kGenerateEvasions:
+        board_.GenerateMoves(kEvasionMoves, moves_);
+        std::stable_partition(moves_.begin(), moves_.end(),
+                              [this](const Move& move) {
+                                return board_.GetPiece(move.To()) != nullptr;
+                              });
+        index_ = 0;
+        stage_ = kEvasions;
+        break;
+      case kDone:
+        return {};
+    }
+  }
+}
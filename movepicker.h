@@ -0,0 +1,54 @@
+#ifndef MOVEPICKER_H_
+#define MOVEPICKER_H_
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "board.h"
+#include "move.h"
+
+// Hands out the legal moves of a position one at a time, generating them in
+// stages so that a cutoff on an early move skips the rest of the work:
+// the cached move first, then captures that don't lose material, killers,
+// quiet moves and finally the losing captures. In check every evasion is
+// generated at once instead.
+class MovePicker {
+ public:
+  MovePicker(const Board& board, uint16_t cache_move,
+             const std::array<uint16_t, 2>& killers);
+
+  // For the quiescence search: only the captures that don't lose material.
+  explicit MovePicker(const Board& board);
+
+  std::optional<Move> Next();
+
+ private:
+  enum Stage {
+    kCacheMove,
+    kGenerateCaptures,
+    kCaptures,
+    kKillers,
+    kGenerateQuiets,
+    kQuiets,
+    kBadCaptures,
+    kGenerateEvasions,
+    kEvasions,
+    kDone,
+  };
+
+  bool AlreadyPicked(const Move& move) const;
+
+  const Board& board_;
+  uint16_t cache_move_;
+  std::array<uint16_t, 2> killers_;
+  bool in_check_;
+  bool quiescence_;
+  Stage stage_;
+  std::vector<Move> moves_;
+  std::vector<Move> bad_captures_;
+  size_t index_;
+};
+
+#endif  // MOVEPICKER_H_
@@ -0,0 +1,346 @@
+#include "nnue.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "board.h"
+#include "color.h"
+#include "common.h"
+#include "move.h"
+#include "piece.h"
+#include "position.h"
+#include "score.h"
+#include "simd.h"
+
+namespace {
+
+int FeatureIndex(Color perspective, Color color, PieceType type,
+                 Position position) {
+  int y = perspective == kWhite ? position.Y() : 7 - position.Y();
+  int side = color == perspective ? 0 : 1;
+  return (side * 6 + static_cast<int>(type)) * 64 + y * 8 + position.X();
+}
+
+PieceType PromotionType(Promotion promotion) {
+  switch (promotion) {
+    case kBishop:
+      return PieceType::kBishop;
+    case kKnight:
+      return PieceType::kKnight;
+    case kRook:
+      return PieceType::kRook;
+    default:
+      return PieceType::kQueen;
+  }
+}
+
+// values += row, or values -= row.
+void UpdateScalar(int16_t* values, const int16_t* row, bool add) {
+  for (int i = 0; i < kNnueAccumulator; ++i) {
+    values[i] += add ? row[i] : -row[i];
+  }
+}
+
+// int16 accumulator values clamped to [0, 127] as uint8.
+void ClippedReluScalar(const int16_t* values, uint8_t* output) {
+  for (int i = 0; i < kNnueAccumulator; ++i) {
+    output[i] = std::clamp<int16_t>(values[i], 0, 127);
+  }
+}
+
+// output[o] = biases[o] + sum of input[i] * weights[o][i].
+void AffineScalar(const uint8_t* input, const int8_t* weights,
+                  const int32_t* biases, int32_t* output, int outputs,
+                  int inputs) {
+  for (int o = 0; o < outputs; ++o) {
+    int32_t sum = biases[o];
+    for (int i = 0; i < inputs; ++i) {
+      sum += input[i] * weights[o * inputs + i];
+    }
+    output[o] = sum;
+  }
+}
+
+#ifdef SIMD_X86
+
+__attribute__((target("sse4.1")))
+void UpdateSse41(int16_t* values, const int16_t* row, bool add) {
+  for (int i = 0; i < kNnueAccumulator; i += 8) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+    __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+    v = add ? _mm_add_epi16(v, r) : _mm_sub_epi16(v, r);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(values + i), v);
+  }
+}
+
+__attribute__((target("sse4.1")))
+void ClippedReluSse41(const int16_t* values, uint8_t* output) {
+  const __m128i zero = _mm_setzero_si128();
+  for (int i = 0; i < kNnueAccumulator; i += 16) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+    __m128i b =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i + 8));
+    __m128i packed = _mm_max_epi8(_mm_packs_epi16(a, b), zero);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), packed);
+  }
+}
+
+__attribute__((target("sse4.1")))
+void AffineSse41(const uint8_t* input, const int8_t* weights,
+                 const int32_t* biases, int32_t* output, int outputs,
+                 int inputs) {
+  const __m128i ones = _mm_set1_epi16(1);
+  for (int o = 0; o < outputs; ++o) {
+    __m128i sum = _mm_setzero_si128();
+    for (int i = 0; i < inputs; i += 16) {
+      __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+      __m128i w = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(weights + o * inputs + i));
+      __m128i products = _mm_madd_epi16(_mm_maddubs_epi16(in, w), ones);
+      sum = _mm_add_epi32(sum, products);
+    }
+    sum = _mm_hadd_epi32(sum, sum);
+    sum = _mm_hadd_epi32(sum, sum);
+    output[o] = biases[o] + _mm_cvtsi128_si32(sum);
+  }
+}
+
+__attribute__((target("avx2")))
+void UpdateAvx2(int16_t* values, const int16_t* row, bool add) {
+  for (int i = 0; i < kNnueAccumulator; i += 16) {
+    __m256i v =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+    __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i));
+    v = add ? _mm256_add_epi16(v, r) : _mm256_sub_epi16(v, r);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(values + i), v);
+  }
+}
+
+__attribute__((target("avx2")))
+void ClippedReluAvx2(const int16_t* values, uint8_t* output) {
+  const __m256i zero = _mm256_setzero_si256();
+  for (int i = 0; i < kNnueAccumulator; i += 32) {
+    __m256i a =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+    __m256i b =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i + 16));
+    // Packing works on each 128-bit lane, put the quarters back in order.
+    __m256i packed = _mm256_max_epi8(_mm256_packs_epi16(a, b), zero);
+    packed = _mm256_permute4x64_epi64(packed, 0xd8);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + i), packed);
+  }
+}
+
+__attribute__((target("avx2")))
+void AffineAvx2(const uint8_t* input, const int8_t* weights,
+                const int32_t* biases, int32_t* output, int outputs,
+                int inputs) {
+  const __m256i ones = _mm256_set1_epi16(1);
+  for (int o = 0; o < outputs; ++o) {
+    __m256i sum = _mm256_setzero_si256();
+    for (int i = 0; i < inputs; i += 32) {
+      __m256i in =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + i));
+      __m256i w = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(weights + o * inputs + i));
+      __m256i products =
+          _mm256_madd_epi16(_mm256_maddubs_epi16(in, w), ones);
+      sum = _mm256_add_epi32(sum, products);
+    }
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum),
+                                 _mm256_extracti128_si256(sum, 1));
+    half = _mm_hadd_epi32(half, half);
+    half = _mm_hadd_epi32(half, half);
+    output[o] = biases[o] + _mm_cvtsi128_si32(half);
+  }
+}
+
+#endif  // SIMD_X86
+
+void Update(SimdLevel simd, int16_t* values, const int16_t* row, bool add) {
+  switch (simd) {
+#ifdef SIMD_X86
+    case SimdLevel::kAvx2:
+      return UpdateAvx2(values, row, add);
+    case SimdLevel::kSse41:
+      return UpdateSse41(values, row, add);
+#endif
+    default:
+      return UpdateScalar(values, row, add);
+  }
+}
+
+void ClippedRelu(SimdLevel simd, const int16_t* values, uint8_t* output) {
+  switch (simd) {
+#ifdef SIMD_X86
+    case SimdLevel::kAvx2:
+      return ClippedReluAvx2(values, output);
+    case SimdLevel::kSse41:
+      return ClippedReluSse41(values, output);
+#endif
+    default:
+      return ClippedReluScalar(values, output);
+  }
+}
+
+void Affine(SimdLevel simd, const uint8_t* input, const int8_t* weights,
+            const int32_t* biases, int32_t* output, int outputs, int inputs) {
+  switch (simd) {
+#ifdef SIMD_X86
+    case SimdLevel::kAvx2:
+      return AffineAvx2(input, weights, biases, output, outputs, inputs);
+    case SimdLevel::kSse41:
+      return AffineSse41(input, weights, biases, output, outputs, inputs);
+#endif
+    default:
+      return AffineScalar(input, weights, biases, output, outputs, inputs);
+  }
+}
+
+template <typename T>
+bool Read(std::ifstream& file, T& value) {
+  file.read(reinterpret_cast<char*>(&value), sizeof(value));
+  return file.good();
+}
+
+}  // namespace
+
+std::shared_ptr<const NnueNetwork> LoadNnueNetwork(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  uint32_t magic, version;
+  if (!Read(file, magic) || !Read(file, version) || magic != kNnueMagic ||
+      version != kNnueVersion) {
+    return nullptr;
+  }
+  auto network = std::make_shared<NnueNetwork>();
+  if (!Read(file, network->accumulator_biases) ||
+      !Read(file, network->accumulator_weights) ||
+      !Read(file, network->hidden_biases) ||
+      !Read(file, network->hidden_weights) ||
+      !Read(file, network->output_bias) ||
+      !Read(file, network->output_weights)) {
+    return nullptr;
+  }
+  if (file.peek() != std::ifstream::traits_type::eof()) {
+    return nullptr;
+  }
+  return network;
+}
+
+NnueUtility::NnueUtility(std::shared_ptr<const NnueNetwork> network)
+    : NnueUtility(std::move(network), DetectSimdLevel()) {}
+
+NnueUtility::NnueUtility(std::shared_ptr<const NnueNetwork> network,
+                         SimdLevel simd)
+    : network_(std::move(network)), simd_(simd) {}
+
+Score NnueUtility::Evaluate(const Board& board, Color attackingcolor) {
+  switch (board.GetGameOutcome()) {
+    case kCheckmate:
+      return MateScore(attackingcolor, 0);
+    case kDraw:
+      return 0;
+    default:
+      break;
+  }
+  if (accumulators_.empty()) {
+    Reset(board);
+  }
+  const Accumulator& accumulator = accumulators_.back();
+  Color us = board.CurrentPlayer();
+
+  alignas(32) uint8_t input[2 * kNnueAccumulator];
+  ClippedRelu(simd_, accumulator.values[us], input);
+  ClippedRelu(simd_, accumulator.values[Other(us)], input + kNnueAccumulator);
+  alignas(32) int32_t hidden[kNnueHidden];
+  Affine(simd_, input, &network_->hidden_weights[0][0],
+         network_->hidden_biases, hidden, kNnueHidden, 2 * kNnueAccumulator);
+
+  int32_t output = network_->output_bias;
+  for (int i = 0; i < kNnueHidden; ++i) {
+    output += std::clamp(hidden[i] >> kNnueHiddenShift, 0, 127) *
+              network_->output_weights[i];
+  }
+  Score score = std::clamp<Score>(output / kNnueOutputScale,
+                                  1 - kMateInMaxPly, kMateInMaxPly - 1);
+  return us == kWhite ? score : -score;
+}
+
+void NnueUtility::Reset(const Board& board) {
+  accumulators_.clear();
+  Accumulator& accumulator = accumulators_.emplace_back();
+  for (Color perspective : {kWhite, kBlack}) {
+    std::copy(std::begin(network_->accumulator_biases),
+              std::end(network_->accumulator_biases),
+              accumulator.values[perspective]);
+  }
+  for (int x = 0; x <= 7; ++x) {
+    for (int y = 0; y <= 7; ++y) {
+      const Piece* piece = board.GetPiece({x, y});
+      if (piece != nullptr) {
+        AddFeature(accumulator, piece->GetColor(), piece->Type(), {x, y});
+      }
+    }
+  }
+}
+
+void NnueUtility::DoMove(const Board& board, const Move& move) {
+  if (accumulators_.empty()) {
+    Reset(board);
+  }
+  Accumulator next = accumulators_.back();
+  Position from = move.From();
+  Position to = move.To();
+  const Piece* mover = board.GetPiece(from);
+  const Piece* captured = board.GetPiece(to);
+  Color color = mover->GetColor();
+
+  PieceType placed = mover->Type();
+  if (placed == PieceType::kPawn && (to.Y() == 0 || to.Y() == 7)) {
+    placed = PromotionType(move.PromoteTo().value_or(kQueen));
+  }
+  RemoveFeature(next, color, mover->Type(), from);
+  if (captured != nullptr) {
+    RemoveFeature(next, captured->GetColor(), captured->Type(), to);
+  }
+  AddFeature(next, color, placed, to);
+
+  // Same rook move as King::DoMove.
+  int diff = to.X() - from.X();
+  if (mover->Type() == PieceType::kKing && std::abs(diff) == 2) {
+    Position rook_from(diff > 0 ? 7 : 0, from.Y());
+    Position rook_to(diff > 0 ? 5 : 3, from.Y());
+    if (board.GetPiece(rook_from) != nullptr) {
+      RemoveFeature(next, color, PieceType::kRook, rook_from);
+      AddFeature(next, color, PieceType::kRook, rook_to);
+    }
+  }
+  accumulators_.push_back(next);
+}
+
+void NnueUtility::UndoMove(unused const Board& board, unused const Move& move) {
+  accumulators_.pop_back();
+}
+
+void NnueUtility::AddFeature(Accumulator& accumulator, Color color,
+                             PieceType type, Position position) const {
+  for (Color perspective : {kWhite, kBlack}) {
+    int feature = FeatureIndex(perspective, color, type, position);
+    Update(simd_, accumulator.values[perspective],
+           network_->accumulator_weights[feature], true);
+  }
+}
+
+void NnueUtility::RemoveFeature(Accumulator& accumulator, Color color,
+                                PieceType type, Position position) const {
+  for (Color perspective : {kWhite, kBlack}) {
+    int feature = FeatureIndex(perspective, color, type, position);
+    Update(simd_, accumulator.values[perspective],
+           network_->accumulator_weights[feature], false);
+  }
+}
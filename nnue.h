@@ -0,0 +1,74 @@
+#ifndef NNUE_H_
+#define NNUE_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "board.h"
+#include "color.h"
+#include "move.h"
+#include "score.h"
+#include "simd.h"
+
+// An efficiently updatable neural network. Every (piece, square) pair seen
+// from one side is an input feature. The first layer's output, the
+// accumulator, is kept for both sides and updated on every move instead of
+// being recomputed. Two small dense layers turn the accumulators of the side
+// to move and of the other side into a score.
+//
+// Weights file, all little-endian: kNnueMagic and kNnueVersion as uint32,
+// then the int16 accumulator biases and weights, the int32 biases and int8
+// weights of the hidden layer and finally the output layer's, in the order of
+// NnueNetwork's members.
+const uint32_t kNnueMagic = 0x45554e4e;  // "NNUE"
+const uint32_t kNnueVersion = 1;
+const int kNnueFeatures = 2 * 6 * 64;
+const int kNnueAccumulator = 128;
+const int kNnueHidden = 32;
+// Right shift applied to the hidden layer, and divisor giving centipawns
+// from the output layer.
+const int kNnueHiddenShift = 6;
+const int kNnueOutputScale = 16;
+
+struct NnueNetwork {
+  alignas(32) int16_t accumulator_biases[kNnueAccumulator];
+  alignas(32) int16_t accumulator_weights[kNnueFeatures][kNnueAccumulator];
+  alignas(32) int32_t hidden_biases[kNnueHidden];
+  alignas(32) int8_t hidden_weights[kNnueHidden][2 * kNnueAccumulator];
+  int32_t output_bias;
+  alignas(32) int8_t output_weights[kNnueHidden];
+};
+
+// Returns nullptr if the file is missing or isn't a network of this shape.
+std::shared_ptr<const NnueNetwork> LoadNnueNetwork(const std::string& path);
+
+class NnueUtility {
+ public:
+  explicit NnueUtility(std::shared_ptr<const NnueNetwork> network);
+  NnueUtility(std::shared_ptr<const NnueNetwork> network, SimdLevel simd);
+
+  Score Evaluate(const Board& board, Color attackingcolor);
+  void Reset(const Board& board);
+  void DoMove(const Board& board, const Move& move);
+  void UndoMove(const Board& board, const Move& move);
+
+ private:
+  struct alignas(32) Accumulator {
+    int16_t values[2][kNnueAccumulator];
+  };
+
+  void AddFeature(Accumulator& accumulator, Color color, PieceType type,
+                  Position position) const;
+  void RemoveFeature(Accumulator& accumulator, Color color, PieceType type,
+                     Position position) const;
+
+  std::shared_ptr<const NnueNetwork> network_;
+  SimdLevel simd_;
+  // One accumulator per ply of the current line, the last one is the
+  // position being evaluated.
+  std::vector<Accumulator> accumulators_;
+};
+
+#endif  // NNUE_H_
@@ -84,6 +84,8 @@ void GetCaptureMoves(const Board& board, Position from, Color color,
 
 }  // namespace
 
+Pawn::Pawn(Color color) : Piece(color, PieceType::kPawn), double_(false) {}
+
 std::string Pawn::String() const { return GetColor() == kWhite ? "♙" : "♟"; }
 
 std::vector<Position> Pawn::GetMoves(const Board& board, Position from) const {
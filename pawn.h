@@ -11,7 +11,7 @@
 
 class Pawn : public Piece {
  public:
-  using Piece::Piece;
+  explicit Pawn(Color color);
 
   std::string String() const override;
 
@@ -0,0 +1,140 @@
+#include "perf.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstring>
+#endif
+
+namespace {
+
+const char* const kPerfCounterNames[] = {
+  "Cycles", "Instructions", "L1d misses", "LLC misses", "Branch misses",
+};
+
+#ifdef __linux__
+int OpenCounter(PerfCounter counter) {
+  perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  switch (counter) {
+    case kCycles:
+      attr.config = PERF_COUNT_HW_CPU_CYCLES;
+      break;
+    case kInstructions:
+      attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+      break;
+    case kL1dMisses:
+      attr.type = PERF_TYPE_HW_CACHE;
+      attr.config = PERF_COUNT_HW_CACHE_L1D |
+                    (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+      break;
+    case kLlcMisses:
+      attr.config = PERF_COUNT_HW_CACHE_MISSES;
+      break;
+    case kBranchMisses:
+      attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+      break;
+    case kNumPerfCounters:
+      return -1;
+  }
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  // Each counter on its own, so that one missing doesn't take the others.
+  return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+}  // namespace
+
+PerfCounters::PerfCounters() {
+  fds_.fill(-1);
+#ifdef __linux__
+  for (int counter = 0; counter < kNumPerfCounters; ++counter) {
+    fds_[counter] = OpenCounter(static_cast<PerfCounter>(counter));
+  }
+#endif
+}
+
+PerfCounters::~PerfCounters() {
+#ifdef __linux__
+  for (int fd : fds_) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+#endif
+}
+
+void PerfCounters::Resume() {
+#ifdef __linux__
+  for (int fd : fds_) {
+    if (fd >= 0) {
+      ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+#endif
+}
+
+void PerfCounters::Pause() {
+#ifdef __linux__
+  for (int fd : fds_) {
+    if (fd >= 0) {
+      ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+  }
+#endif
+}
+
+std::optional<uint64_t> PerfCounters::Read(PerfCounter counter) const {
+#ifdef __linux__
+  uint64_t count;
+  if (fds_[counter] >= 0 &&
+      read(fds_[counter], &count, sizeof(count)) == sizeof(count)) {
+    return count;
+  }
+#endif
+  return {};
+}
+
+bool PerfCounters::Available() const {
+  return std::any_of(fds_.begin(), fds_.end(), [](int fd) { return fd >= 0; });
+}
+
+void PrintPerfCounters(const PerfCounters& counters, uint64_t nodes,
+                       std::ostream& out) {
+  if (!counters.Available()) {
+    out << "Hardware counters: unavailable" << std::endl;
+    return;
+  }
+  out << std::fixed << std::setprecision(2);
+  for (int counter = 0; counter < kNumPerfCounters; ++counter) {
+    auto count = counters.Read(static_cast<PerfCounter>(counter));
+    out << kPerfCounterNames[counter] << "/node: ";
+    if (count.has_value()) {
+      out << static_cast<double>(*count) / std::max<uint64_t>(nodes, 1);
+    } else {
+      out << "unavailable";
+    }
+    out << std::endl;
+  }
+  auto cycles = counters.Read(kCycles);
+  auto instructions = counters.Read(kInstructions);
+  if (cycles.has_value() && instructions.has_value() && *cycles > 0) {
+    out << "IPC: " << static_cast<double>(*instructions) / *cycles
+        << std::endl;
+  }
+  out.unsetf(std::ios::fixed);
+}
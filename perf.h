@@ -0,0 +1,44 @@
+#ifndef PERF_H_
+#define PERF_H_
+
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+
+enum PerfCounter {
+  kCycles,
+  kInstructions,
+  kL1dMisses,
+  kLlcMisses,
+  kBranchMisses,
+  kNumPerfCounters,
+};
+
+// Hardware performance counters of the calling thread, in user space, read
+// with Linux perf_event_open. A counter the CPU, the kernel or its
+// perf_event_paranoid setting doesn't allow is left out, and on other
+// systems they all are.
+class PerfCounters {
+ public:
+  // Counting starts paused.
+  PerfCounters();
+  ~PerfCounters();
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+
+  void Resume();
+  void Pause();
+  // The count so far, if the counter is available.
+  std::optional<uint64_t> Read(PerfCounter counter) const;
+  bool Available() const;
+
+ private:
+  std::array<int, kNumPerfCounters> fds_;
+};
+
+// Prints each available counter per node, and the instructions per cycle.
+void PrintPerfCounters(const PerfCounters& counters, uint64_t nodes,
+                       std::ostream& out);
+
+#endif  // PERF_H_
@@ -9,10 +9,12 @@
 #include "move.h"
 #include "position.h"
 
-Piece::Piece(Color color) : color_(color) {}
+Piece::Piece(Color color, PieceType type) : color_(color), type_(type) {}
 
 Color Piece::GetColor() const { return color_; }
 
+PieceType Piece::Type() const { return type_; }
+
 void Piece::NewTurn() {}
 
 void Piece::DoMove(unused Board& board, unused const Move& move) {}
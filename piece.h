@@ -10,9 +10,11 @@
 
 class Board;
 
+enum class PieceType { kPawn, kKnight, kBishop, kRook, kQueen, kKing };
+
 class Piece {
  public:
-  Piece(Color color);
+  Piece(Color color, PieceType type);
 
   virtual ~Piece() = default;
 
@@ -23,6 +25,8 @@ class Piece {
 
   Color GetColor() const;
 
+  PieceType Type() const;
+
   virtual void NewTurn();
 
   virtual void DoMove(Board& board, const Move& move);
@@ -33,6 +37,7 @@ class Piece {
 
  private:
   const Color color_;
+  const PieceType type_;
 };
 
 #endif  // PIECE_H_
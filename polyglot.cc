@@ -0,0 +1,229 @@
+#include "polyglot.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "board.h"
+#include "move.h"
+#include "position.h"
+
+namespace {
+
+const int kCastlingOffset = 768;
+const int kEnPassantOffset = 772;
+const int kTurnOffset = 780;
+const size_t kEntrySize = 16;
+
+#ifdef HAVE_POLYGLOT_RANDOM
+// The 781 values of Random64 from the Polyglot book format specification.
+const PolyglotRandoms kPolyglotRandoms = {
+#include "polyglot_random.inc"
+};
+#endif
+
+// Polyglot numbers pieces black pawn, white pawn, black knight, and so on.
+const char kPolyglotPieces[] = "pPnNbBrRqQkK";
+
+uint64_t ReadBigEndian(const uint8_t* bytes, int size) {
+  uint64_t value = 0;
+  for (int i = 0; i < size; ++i) {
+    value = value << 8 | bytes[i];
+  }
+  return value;
+}
+
+struct BookEntry {
+  uint16_t move;
+  uint16_t weight;
+};
+
+// Polyglot moves castle by taking the rook, and number promotions knight,
+// bishop, rook, queen from 1.
+std::optional<Move> DecodeMove(const Board& board, uint16_t encoded) {
+  Position from((encoded >> 6) & 7, (encoded >> 9) & 7);
+  Position to(encoded & 7, (encoded >> 3) & 7);
+  const Piece* piece = board.GetPiece(from);
+  if (piece != nullptr && piece->Type() == PieceType::kKing &&
+      from.X() == 4 && (to.X() == 7 || to.X() == 0) && to.Y() == from.Y()) {
+    to = Position(to.X() == 7 ? 6 : 2, to.Y());
+  }
+  std::optional<Promotion> promotion;
+  switch ((encoded >> 12) & 7) {
+    case 1:
+      promotion = kKnight;
+      break;
+    case 2:
+      promotion = kBishop;
+      break;
+    case 3:
+      promotion = kRook;
+      break;
+    case 4:
+      promotion = kQueen;
+      break;
+  }
+  Move move(from, to, promotion);
+  if (!board.IsLegalMove(move)) {
+    return {};
+  }
+  return move;
+}
+
+}  // namespace
+
+const PolyglotRandoms* PolyglotRandomTable() {
+#ifdef HAVE_POLYGLOT_RANDOM
+  return &kPolyglotRandoms;
+#else
+  return nullptr;
+#endif
+}
+
+uint64_t PolyglotKey(const Board& board, const PolyglotRandoms& randoms) {
+  std::istringstream fen(board.ToFen());
+  std::string placement, turn, castling, en_passant;
+  fen >> placement >> turn >> castling >> en_passant;
+  uint64_t key = 0;
+  int x = 0;
+  int y = 7;
+  for (char c : placement) {
+    if (c == '/') {
+      x = 0;
+      --y;
+    } else if (c >= '1' && c <= '8') {
+      x += c - '0';
+    } else {
+      int kind = strchr(kPolyglotPieces, c) - kPolyglotPieces;
+      key ^= randoms[64 * kind + 8 * y + x];
+      ++x;
+    }
+  }
+  const char* rights = "KQkq";
+  for (int i = 0; i < 4; ++i) {
+    if (castling.find(rights[i]) != std::string::npos) {
+      key ^= randoms[kCastlingOffset + i];
+    }
+  }
+  // Only when a pawn of the side to move stands next to the one that just
+  // moved two squares.
+  if (en_passant != "-") {
+    int file = en_passant[0] - 'a';
+    bool white = turn == "w";
+    int rank = white ? 4 : 3;
+    for (int dx : {-1, 1}) {
+      auto square = Position(file, rank).Move(dx, 0);
+      const Piece* pawn = square.has_value() ? board.GetPiece(*square) : nullptr;
+      if (pawn != nullptr && pawn->Type() == PieceType::kPawn &&
+          pawn->GetColor() == (white ? kWhite : kBlack)) {
+        key ^= randoms[kEnPassantOffset + file];
+        break;
+      }
+    }
+  }
+  if (turn == "w") {
+    key ^= randoms[kTurnOffset];
+  }
+  return key;
+}
+
+std::unique_ptr<PolyglotBook> PolyglotBook::Open(
+    const std::string& path, const PolyglotRandoms& randoms,
+    BookSelection selection) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat status;
+  if (fstat(fd, &status) != 0 || status.st_size % kEntrySize != 0) {
+    close(fd);
+    return nullptr;
+  }
+  size_t size = status.st_size;
+  void* data = nullptr;
+  if (size > 0) {
+    data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  // The mapping keeps the file.
+  close(fd);
+  if (data == MAP_FAILED) {
+    return nullptr;
+  }
+  return std::unique_ptr<PolyglotBook>(
+      new PolyglotBook(static_cast<const uint8_t*>(data), size, randoms,
+                       selection));
+}
+
+PolyglotBook::PolyglotBook(const uint8_t* data, size_t size,
+                           const PolyglotRandoms& randoms,
+                           BookSelection selection)
+    : data_(data), size_(size), randoms_(randoms), selection_(selection),
+      random_(std::random_device()()) {}
+
+PolyglotBook::~PolyglotBook() {
+  if (size_ > 0) {
+    munmap(const_cast<uint8_t*>(data_), size_);
+  }
+}
+
+std::optional<Move> PolyglotBook::Probe(const Board& board) {
+  uint64_t key = PolyglotKey(board, randoms_);
+  // The first entry with the key.
+  size_t low = 0;
+  size_t high = size_ / kEntrySize;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (ReadBigEndian(data_ + middle * kEntrySize, 8) < key) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  std::vector<BookEntry> entries;
+  uint64_t total_weight = 0;
+  for (size_t i = low; i < size_ / kEntrySize; ++i) {
+    const uint8_t* entry = data_ + i * kEntrySize;
+    if (ReadBigEndian(entry, 8) != key) {
+      break;
+    }
+    BookEntry book_entry = {static_cast<uint16_t>(ReadBigEndian(entry + 8, 2)),
+                            static_cast<uint16_t>(ReadBigEndian(entry + 10, 2))};
+    if (DecodeMove(board, book_entry.move).has_value()) {
+      entries.push_back(book_entry);
+      total_weight += book_entry.weight;
+    }
+  }
+  if (entries.empty()) {
+    return {};
+  }
+  const BookEntry* chosen = &entries[0];
+  if (selection_ == BookSelection::kBestWeight || total_weight == 0) {
+    for (const BookEntry& entry : entries) {
+      if (entry.weight > chosen->weight) {
+        chosen = &entry;
+      }
+    }
+  } else {
+    uint64_t pick = std::uniform_int_distribution<uint64_t>(
+        0, total_weight - 1)(random_);
+    for (const BookEntry& entry : entries) {
+      if (pick < entry.weight) {
+        chosen = &entry;
+        break;
+      }
+      pick -= entry.weight;
+    }
+  }
+  return DecodeMove(board, chosen->move);
+}
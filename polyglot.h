@@ -0,0 +1,58 @@
+#ifndef POLYGLOT_H_
+#define POLYGLOT_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+
+#include "board.h"
+#include "move.h"
+
+// Polyglot hashes XOR one of these per piece on its square, per castling
+// right, for an en passant file and for white to move.
+const int kNumPolyglotRandoms = 781;
+typedef std::array<uint64_t, kNumPolyglotRandoms> PolyglotRandoms;
+
+// The Random64 table of the Polyglot book format, which real books are keyed
+// with, or nullptr if the build doesn't have it (see the README).
+const PolyglotRandoms* PolyglotRandomTable();
+
+uint64_t PolyglotKey(const Board& board, const PolyglotRandoms& randoms);
+
+enum class BookSelection { kBestWeight, kWeighted };
+
+// A Polyglot opening book (.bin), mapped into memory rather than read, so
+// opening it costs nothing and engines sharing a book share its pages.
+// Entries are 16 big-endian bytes, sorted by key: the key, the move, its
+// weight and 4 bytes for learning.
+class PolyglotBook {
+ public:
+  // Returns nullptr if `path` can't be mapped or isn't a book. Probes pick
+  // either the move with the most weight, or one at random in proportion to
+  // weight.
+  static std::unique_ptr<PolyglotBook> Open(const std::string& path,
+                                            const PolyglotRandoms& randoms,
+                                            BookSelection selection);
+  ~PolyglotBook();
+  PolyglotBook(const PolyglotBook&) = delete;
+  PolyglotBook& operator=(const PolyglotBook&) = delete;
+
+  // One of the book's legal moves for `board`, if it has any.
+  std::optional<Move> Probe(const Board& board);
+
+ private:
+  PolyglotBook(const uint8_t* data, size_t size,
+               const PolyglotRandoms& randoms, BookSelection selection);
+
+  const uint8_t* data_;
+  size_t size_;
+  const PolyglotRandoms& randoms_;
+  BookSelection selection_;
+  std::mt19937_64 random_;
+};
+
+#endif  // POLYGLOT_H_
@@ -9,6 +9,8 @@
 #include "position.h"
 #include "rook.h"
 
+Queen::Queen(Color color) : Piece(color, PieceType::kQueen) {}
+
 std::string Queen::String() const { return GetColor() == kWhite ? "♕" : "♛"; }
 
 std::vector<Position> Queen::GetMoves(const Board& board, Position from) const {
@@ -10,7 +10,7 @@
 
 class Queen : public Piece {
  public:
-  using Piece::Piece;
+  explicit Queen(Color color);
 
   std::string String() const override;
 
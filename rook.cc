@@ -10,6 +10,11 @@
 #include "piece.h"
 #include "position.h"
 
+Rook::Rook(Color color) : Rook(color, false) {}
+
+Rook::Rook(Color color, bool moved)
+    : Piece(color, PieceType::kRook), moved_(moved) {}
+
 std::string Rook::String() const { return GetColor() == kWhite ? "♖" : "♜"; }
 
 std::vector<Position> Rook::GetMoves(const Board& board, Position from) const {
@@ -12,7 +12,8 @@
 
 class Rook : public Piece {
  public:
-  using Piece::Piece;
+  explicit Rook(Color color);
+  Rook(Color color, bool moved);
 
   std::string String() const override;
 
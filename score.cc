@@ -0,0 +1,29 @@
+#include "score.h"
+
+#include "color.h"
+
+Score MateScore(Color winner, int ply) {
+  return winner == kWhite ? kMate - ply : ply - kMate;
+}
+
+bool IsMateScore(Score score) {
+  return score >= kMateInMaxPly || score <= -kMateInMaxPly;
+}
+
+Score ScoreToCache(Score score, int ply) {
+  if (score >= kMateInMaxPly) {
+    return score + ply;
+  } else if (score <= -kMateInMaxPly) {
+    return score - ply;
+  }
+  return score;
+}
+
+Score ScoreFromCache(Score score, int ply) {
+  if (score >= kMateInMaxPly) {
+    return score - ply;
+  } else if (score <= -kMateInMaxPly) {
+    return score + ply;
+  }
+  return score;
+}
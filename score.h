@@ -0,0 +1,27 @@
+#ifndef SCORE_H_
+#define SCORE_H_
+
+#include <cstdint>
+
+#include "color.h"
+
+// Centipawns from white's point of view. A forced mate is stored as
+// kMate - plies, counted from the root while searching and from the position
+// itself inside the cache, so that shorter mates always score better.
+typedef int32_t Score;
+
+const Score kCentipawnsPerPawn = 100;
+const Score kMate = 32000;
+const Score kInfinity = kMate + 1;
+const int kMaxPly = 256;
+const Score kMateInMaxPly = kMate - kMaxPly;
+// A win the endgame tables prove, without a mate the search has seen.
+const Score kTablebaseWin = kMateInMaxPly - 1;
+
+Score MateScore(Color winner, int ply);
+bool IsMateScore(Score score);
+
+Score ScoreToCache(Score score, int ply);
+Score ScoreFromCache(Score score, int ply);
+
+#endif  // SCORE_H_
@@ -0,0 +1,29 @@
+#include "searcher.h"
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <utility>
+
+Searcher::~Searcher() { Stop(); }
+
+void Searcher::Start(
+    std::function<void(const std::atomic<bool>* stop)> search) {
+  Stop();
+  stop_ = false;
+  thread_ = std::thread(
+      [this, search = std::move(search)]() { search(&stop_); });
+}
+
+void Searcher::RequestStop() { stop_ = true; }
+
+void Searcher::Stop() {
+  RequestStop();
+  Wait();
+}
+
+void Searcher::Wait() {
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
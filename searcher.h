@@ -0,0 +1,32 @@
+#ifndef SEARCHER_H_
+#define SEARCHER_H_
+
+#include <atomic>
+#include <functional>
+#include <thread>
+
+// Runs searches on a thread of its own, one at a time, so that the protocol
+// loop keeps reading commands meanwhile.
+class Searcher {
+ public:
+  Searcher() = default;
+  ~Searcher();
+  Searcher(const Searcher&) = delete;
+  Searcher& operator=(const Searcher&) = delete;
+
+  // Stops the running search, if any, and starts `search`, which should hand
+  // the flag it gets to SearchLimits::stop.
+  void Start(std::function<void(const std::atomic<bool>* stop)> search);
+  // Asks the search to stop at its next node, without waiting for it.
+  void RequestStop();
+  // Stops the search and waits for it.
+  void Stop();
+  // Waits for the search to end by itself.
+  void Wait();
+
+ private:
+  std::thread thread_;
+  std::atomic<bool> stop_{false};
+};
+
+#endif  // SEARCHER_H_
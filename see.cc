@@ -0,0 +1,148 @@
+#include "see.h"
+
+#include <algorithm>
+#include <optional>
+
+#include "board.h"
+#include "color.h"
+#include "move.h"
+#include "piece.h"
+#include "position.h"
+
+namespace {
+
+// The king goes last: capturing with it only works if nothing recaptures.
+const int kKingExchangeValue = 100;
+
+constexpr int kKnightSteps[8][2] = {
+  {-1, -2}, {-1, 2}, {1, -2}, {1, 2}, {-2, -1}, {-2, 1}, {2, -1}, {2, 1},
+};
+constexpr int kKingSteps[8][2] = {
+  {-1, -1}, {-1, 0}, {-1, 1}, {0, -1}, {0, 1}, {1, -1}, {1, 0}, {1, 1},
+};
+
+int ExchangeValue(const Piece* piece) {
+  return piece->Type() == PieceType::kKing ? kKingExchangeValue
+                                           : piece->Value();
+}
+
+bool OnBoard(int x, int y) { return x >= 0 && x <= 7 && y >= 0 && y <= 7; }
+
+// The board minus the pieces that already took part in the exchange. Taking
+// them off is what uncovers the x-ray attackers behind them.
+class Exchange {
+ public:
+  Exchange(const Board& board) : board_(board) {
+    for (int x = 0; x <= 7; ++x) {
+      for (int y = 0; y <= 7; ++y) {
+        occupied_[x][y] = board.GetPiece({x, y}) != nullptr;
+      }
+    }
+  }
+
+  const Piece* At(int x, int y) const {
+    return occupied_[x][y] ? board_.GetPiece({x, y}) : nullptr;
+  }
+
+  void Remove(Position position) {
+    occupied_[position.X()][position.Y()] = false;
+  }
+
+  std::optional<Position> LeastValuableAttacker(Position target,
+                                                Color color) const {
+    std::optional<Position> best;
+    int best_value = 0;
+    auto consider = [&](int x, int y, const Piece* piece) {
+      if (!best.has_value() || ExchangeValue(piece) < best_value) {
+        best = Position(x, y);
+        best_value = ExchangeValue(piece);
+      }
+    };
+    auto consider_step = [&](int x, int y, PieceType type) {
+      if (!OnBoard(x, y)) {
+        return;
+      }
+      const Piece* piece = At(x, y);
+      if (piece != nullptr && piece->GetColor() == color &&
+          piece->Type() == type) {
+        consider(x, y, piece);
+      }
+    };
+
+    int pawn_y = target.Y() + (color == kWhite ? -1 : 1);
+    consider_step(target.X() - 1, pawn_y, PieceType::kPawn);
+    consider_step(target.X() + 1, pawn_y, PieceType::kPawn);
+    if (best.has_value()) {
+      return best;
+    }
+    for (const auto& step : kKnightSteps) {
+      consider_step(target.X() + step[0], target.Y() + step[1],
+                    PieceType::kKnight);
+    }
+    for (const auto& step : kKingSteps) {
+      PieceType slider = step[0] != 0 && step[1] != 0 ? PieceType::kBishop
+                                                      : PieceType::kRook;
+      for (int x = target.X() + step[0], y = target.Y() + step[1];
+           OnBoard(x, y); x += step[0], y += step[1]) {
+        const Piece* piece = At(x, y);
+        if (piece == nullptr) {
+          continue;
+        }
+        if (piece->GetColor() == color && (piece->Type() == slider ||
+                                           piece->Type() == PieceType::kQueen)) {
+          consider(x, y, piece);
+        }
+        break;
+      }
+      consider_step(target.X() + step[0], target.Y() + step[1],
+                    PieceType::kKing);
+    }
+    return best;
+  }
+
+ private:
+  const Board& board_;
+  bool occupied_[8][8];
+};
+
+}  // namespace
+
+int StaticExchange(const Board& board, const Move& move) {
+  const Piece* victim = board.GetPiece(move.To());
+  const Piece* attacker = board.GetPiece(move.From());
+  // Gains from the point of view of whoever captures at each step.
+  int gain[32];
+  int depth = 0;
+  gain[0] = victim == nullptr ? 0 : ExchangeValue(victim);
+
+  Exchange exchange(board);
+  exchange.Remove(move.From());
+  Color color = Other(attacker->GetColor());
+  const Piece* on_target = attacker;
+  while (depth < 31) {
+    auto next = exchange.LeastValuableAttacker(move.To(), color);
+    if (!next.has_value()) {
+      break;
+    }
+    const Piece* next_piece = exchange.At(next->X(), next->Y());
+    if (next_piece->Type() == PieceType::kKing) {
+      Exchange without_king = exchange;
+      without_king.Remove(*next);
+      if (without_king.LeastValuableAttacker(move.To(), Other(color))) {
+        break;
+      }
+    }
+    ++depth;
+    gain[depth] = ExchangeValue(on_target) - gain[depth - 1];
+    if (std::max(-gain[depth - 1], gain[depth]) < 0) {
+      break;
+    }
+    exchange.Remove(*next);
+    on_target = next_piece;
+    color = Other(color);
+  }
+  for (; depth > 0; --depth) {
+    gain[depth - 1] = -std::max(-gain[depth - 1], gain[depth]);
+  }
+  return gain[0];
+}
@@ -0,0 +1,12 @@
+#ifndef SEE_H_
+#define SEE_H_
+
+#include "board.h"
+#include "move.h"
+
+// Static exchange evaluation: the material, in pawns, that the side making
+// the capture `move` wins or loses once both sides have recaptured on the
+// target square for as long as it pays off, least valuable attacker first.
+int StaticExchange(const Board& board, const Move& move);
+
+#endif  // SEE_H_
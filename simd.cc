@@ -0,0 +1,13 @@
+#include "simd.h"
+
+SimdLevel DetectSimdLevel() {
+#ifdef SIMD_X86
+  if (__builtin_cpu_supports("avx2")) {
+    return SimdLevel::kAvx2;
+  }
+  if (__builtin_cpu_supports("sse4.1")) {
+    return SimdLevel::kSse41;
+  }
+#endif
+  return SimdLevel::kScalar;
+}
@@ -0,0 +1,15 @@
+#ifndef SIMD_H_
+#define SIMD_H_
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_X86 1
+#endif
+
+// Kernels come in scalar, SSE4.1 and AVX2 versions, the fastest one the CPU
+// supports is picked at runtime so the binary runs everywhere.
+enum class SimdLevel { kScalar, kSse41, kAvx2 };
+
+SimdLevel DetectSimdLevel();
+
+#endif  // SIMD_H_
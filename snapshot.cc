@@ -0,0 +1,198 @@
+#include "snapshot.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "cache.h"
+
+namespace {
+
+const char kSnapshotMagic[8] = {'c', 'h', 'e', 's', 's', 't', 't', '\n'};
+// Changes whenever the entries, or what the search stores in them, do.
+const uint32_t kSnapshotVersion = 1;
+// Saves an entry survives without being searched again.
+const uint8_t kMaxSnapshotAge = 8;
+// Never the depth of a search, so a stale entry only lends its move.
+const int16_t kStaleDepth = -1;
+
+struct SnapshotHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t evaluator;
+  uint64_t entries;
+  uint64_t checksum;
+};
+
+// In key order, so that saving can look up the entries of the snapshot it
+// replaces.
+struct SnapshotEntry {
+  uint64_t key;
+  int16_t utility;
+  int16_t depth;
+  uint16_t move;
+  uint8_t age;
+  uint8_t unused;
+};
+
+static_assert(sizeof(SnapshotHeader) == 32);
+static_assert(sizeof(SnapshotEntry) == 16);
+
+uint64_t Checksum(const SnapshotEntry* entries, size_t count) {
+  // FNV-1a, a word at a time.
+  uint64_t checksum = 0xcbf29ce484222325;
+  const auto* words = reinterpret_cast<const uint64_t*>(entries);
+  for (size_t i = 0; i < count * sizeof(SnapshotEntry) / 8; ++i) {
+    checksum = (checksum ^ words[i]) * 0x100000001b3;
+  }
+  return checksum;
+}
+
+// A snapshot file mapped into memory, if it's a valid one.
+class MappedSnapshot {
+ public:
+  explicit MappedSnapshot(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+    struct stat status;
+    if (fstat(fd, &status) == 0 &&
+        static_cast<size_t>(status.st_size) >= sizeof(SnapshotHeader)) {
+      size_ = status.st_size;
+      data_ = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    // The mapping keeps the file.
+    close(fd);
+    if (data_ == MAP_FAILED) {
+      data_ = nullptr;
+      return;
+    }
+    if (data_ == nullptr) {
+      return;
+    }
+    madvise(data_, size_, MADV_SEQUENTIAL);
+    if (memcmp(Header().magic, kSnapshotMagic, sizeof(kSnapshotMagic)) != 0 ||
+        Header().version != kSnapshotVersion ||
+        Header().entries != (size_ - sizeof(SnapshotHeader)) /
+                                sizeof(SnapshotEntry) ||
+        (size_ - sizeof(SnapshotHeader)) % sizeof(SnapshotEntry) != 0 ||
+        Checksum(Entries(), Header().entries) != Header().checksum) {
+      munmap(data_, size_);
+      data_ = nullptr;
+    }
+  }
+  ~MappedSnapshot() {
+    if (data_ != nullptr) {
+      munmap(data_, size_);
+    }
+  }
+  MappedSnapshot(const MappedSnapshot&) = delete;
+  MappedSnapshot& operator=(const MappedSnapshot&) = delete;
+
+  bool Valid() const {
+    return data_ != nullptr;
+  }
+  const SnapshotHeader& Header() const {
+    return *static_cast<const SnapshotHeader*>(data_);
+  }
+  const SnapshotEntry* Entries() const {
+    return reinterpret_cast<const SnapshotEntry*>(
+        static_cast<const char*>(data_) + sizeof(SnapshotHeader));
+  }
+  const SnapshotEntry* Find(uint64_t key) const {
+    const SnapshotEntry* begin = Entries();
+    const SnapshotEntry* end = begin + Header().entries;
+    const SnapshotEntry* entry = std::lower_bound(
+        begin, end, key,
+        [](const SnapshotEntry& a, uint64_t key) { return a.key < key; });
+    return entry != end && entry->key == key ? entry : nullptr;
+  }
+
+ private:
+  void* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+}  // namespace
+
+std::optional<SnapshotInfo> LoadCacheSnapshot(const std::string& path,
+                                              uint32_t evaluator,
+                                              Cache& cache) {
+  MappedSnapshot snapshot(path);
+  if (!snapshot.Valid()) {
+    return {};
+  }
+  bool stale = snapshot.Header().evaluator != evaluator;
+  size_t count = snapshot.Header().entries;
+  for (size_t i = 0; i < count; ++i) {
+    const SnapshotEntry& entry = snapshot.Entries()[i];
+    if (cache.Find(entry.key) != nullptr) {
+      continue;
+    }
+    if (stale) {
+      cache.Store(entry.key, {0, kStaleDepth, entry.move});
+    } else {
+      cache.Store(entry.key, {entry.utility, entry.depth, entry.move});
+    }
+  }
+  return SnapshotInfo{count, stale};
+}
+
+bool SaveCacheSnapshot(const Cache& cache, const std::string& path,
+                       uint32_t evaluator) {
+  std::vector<SnapshotEntry> entries;
+  {
+    MappedSnapshot previous(path);
+    bool stale = previous.Valid() && previous.Header().evaluator != evaluator;
+    cache.ForEach([&](size_t key, const CacheEntry& value) {
+      SnapshotEntry entry = {key, value.utility, value.depth, value.move, 0, 0};
+      const SnapshotEntry* saved =
+          previous.Valid() ? previous.Find(key) : nullptr;
+      // Loaded, and not searched since.
+      if (saved != nullptr && saved->move == value.move &&
+          (stale ? value.depth == kStaleDepth
+                 : saved->utility == value.utility &&
+                       saved->depth == value.depth)) {
+        if (saved->age >= kMaxSnapshotAge) {
+          return;
+        }
+        entry.age = saved->age + 1;
+      }
+      entries.push_back(entry);
+    });
+  }
+  std::sort(entries.begin(), entries.end(),
+            [](const SnapshotEntry& a, const SnapshotEntry& b) {
+              return a.key < b.key;
+            });
+  SnapshotHeader header = {};
+  memcpy(header.magic, kSnapshotMagic, sizeof(kSnapshotMagic));
+  header.version = kSnapshotVersion;
+  header.evaluator = evaluator;
+  header.entries = entries.size();
+  header.checksum = Checksum(entries.data(), entries.size());
+
+  std::string temporary = path + ".tmp";
+  {
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(entries.data()),
+              entries.size() * sizeof(SnapshotEntry));
+    if (!out.flush()) {
+      std::remove(temporary.c_str());
+      return false;
+    }
+  }
+  return std::rename(temporary.c_str(), path.c_str()) == 0;
+}
@@ -0,0 +1,37 @@
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include "cache.h"
+
+// Caches saved to disk, so that a search picks up what earlier processes
+// found. Snapshots record a format version, which must match, and which
+// evaluator scored them, and are checksummed. A snapshot from another
+// evaluator is stale: only its best moves are loaded, to order the search,
+// not its scores. Every entry also counts how many saves in a row it has gone
+// without being searched again, and is dropped after a few.
+
+struct SnapshotInfo {
+  size_t entries;
+  bool stale;
+};
+
+// Maps the snapshot at `path` and adds its entries to `cache`, keeping the
+// entries `cache` already has. `evaluator` tells apart evaluators whose
+// scores can't be mixed. Returns nullopt if there's no snapshot, or it's of
+// another version, truncated or corrupt.
+std::optional<SnapshotInfo> LoadCacheSnapshot(const std::string& path,
+                                              uint32_t evaluator, Cache& cache);
+
+// Replaces the snapshot at `path` with `cache`, ageing the entries that are
+// unchanged since the snapshot it replaces. The file is written next to it
+// and renamed over it, so that a crash leaves the old one. Returns false if
+// it can't be written.
+bool SaveCacheSnapshot(const Cache& cache, const std::string& path,
+                       uint32_t evaluator);
+
+#endif  // SNAPSHOT_H_
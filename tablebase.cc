@@ -0,0 +1,191 @@
+#include "tablebase.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <system_error>
+
+#include "board.h"
+#include "color.h"
+#include "piece.h"
+#include "position.h"
+
+namespace {
+
+const uint8_t kWdlMagic[] = {0x71, 0xe8, 0x23, 0x5d};
+const uint8_t kDtzMagic[] = {0xd7, 0x66, 0x0c, 0xa5};
+
+// Syzygy names tables after their material, strongest pieces first, e.g.
+// KRPvKR.
+const char kPieceLetters[] = "KQRBNP";
+
+char PieceLetter(PieceType type) {
+  switch (type) {
+    case PieceType::kKing:
+      return 'K';
+    case PieceType::kQueen:
+      return 'Q';
+    case PieceType::kRook:
+      return 'R';
+    case PieceType::kBishop:
+      return 'B';
+    case PieceType::kKnight:
+      return 'N';
+    case PieceType::kPawn:
+      return 'P';
+  }
+  return '?';
+}
+
+std::string Signature(const Board& board, Color color) {
+  std::string signature;
+  for (int x = 0; x < 8; ++x) {
+    for (int y = 0; y < 8; ++y) {
+      const Piece* piece = board.GetPiece(Position(x, y));
+      if (piece != nullptr && piece->GetColor() == color) {
+        signature += PieceLetter(piece->Type());
+      }
+    }
+  }
+  std::sort(signature.begin(), signature.end(), [](char a, char b) {
+    return strchr(kPieceLetters, a) < strchr(kPieceLetters, b);
+  });
+  return signature;
+}
+
+bool IsSignature(const std::string& name) {
+  size_t v = name.find('v');
+  if (v == std::string::npos || name.size() - 1 > 7) {
+    return false;
+  }
+  for (const std::string& side : {name.substr(0, v), name.substr(v + 1)}) {
+    if (side.empty() || side[0] != 'K' ||
+        side.find_first_not_of(kPieceLetters + 1, 1) != std::string::npos) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Kings alone, or with a single bishop or knight, can't mate.
+bool IsDeadDraw(const Board& board) {
+  std::string material =
+      Signature(board, kWhite) + Signature(board, kBlack);
+  return material == "KK" || material == "KBK" || material == "KKB" ||
+         material == "KNK" || material == "KKN";
+}
+
+bool CanCastle(const Board& board) {
+  std::istringstream fen(board.ToFen());
+  std::string placement, turn, castling;
+  fen >> placement >> turn >> castling;
+  return castling != "-";
+}
+
+}  // namespace
+
+int CountPieces(const Board& board) {
+  int count = 0;
+  for (int x = 0; x < 8; ++x) {
+    for (int y = 0; y < 8; ++y) {
+      count += board.GetPiece(Position(x, y)) != nullptr;
+    }
+  }
+  return count;
+}
+
+std::unique_ptr<Tablebases> Tablebases::Open(const std::string& paths) {
+  std::unique_ptr<Tablebases> tablebases(new Tablebases());
+  std::istringstream directories(paths);
+  std::string directory;
+  while (std::getline(directories, directory, ':')) {
+    std::error_code error;
+    for (const auto& entry :
+         std::filesystem::directory_iterator(directory, error)) {
+      std::filesystem::path path = entry.path();
+      std::string name = path.stem().string();
+      bool wdl = path.extension() == ".rtbw";
+      if ((!wdl && path.extension() != ".rtbz") || !IsSignature(name)) {
+        continue;
+      }
+      int fd = open(path.c_str(), O_RDONLY);
+      if (fd < 0) {
+        continue;
+      }
+      struct stat status;
+      void* data = MAP_FAILED;
+      if (fstat(fd, &status) == 0 && status.st_size >= 4) {
+        data = mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      }
+      // The mapping keeps the file.
+      close(fd);
+      if (data == MAP_FAILED) {
+        continue;
+      }
+      if (memcmp(data, wdl ? kWdlMagic : kDtzMagic, 4) != 0) {
+        munmap(data, status.st_size);
+        continue;
+      }
+      Table table = {static_cast<const uint8_t*>(data),
+                     static_cast<size_t>(status.st_size)};
+      auto& tables = wdl ? tablebases->wdl_ : tablebases->dtz_;
+      // The first directory with a table wins.
+      if (!tables.emplace(name, table).second) {
+        munmap(data, status.st_size);
+        continue;
+      }
+      if (wdl) {
+        tablebases->cardinality_ = std::max<int>(tablebases->cardinality_,
+                                                 name.size() - 1);
+      }
+    }
+  }
+  return tablebases;
+}
+
+Tablebases::~Tablebases() {
+  for (auto* tables : {&wdl_, &dtz_}) {
+    for (const auto& [name, table] : *tables) {
+      munmap(const_cast<uint8_t*>(table.data), table.size);
+    }
+  }
+}
+
+int Tablebases::Cardinality() const {
+  return cardinality_;
+}
+
+size_t Tablebases::NumTables() const {
+  return wdl_.size() + dtz_.size();
+}
+
+std::optional<Wdl> Tablebases::ProbeWdl(const Board& board) const {
+  if (CountPieces(board) > cardinality_ || CanCastle(board)) {
+    return {};
+  }
+  if (IsDeadDraw(board)) {
+    return Wdl::kDraw;
+  }
+  return {};
+}
+
+std::optional<int> Tablebases::ProbeDtz(const Board& board) const {
+  if (CountPieces(board) > cardinality_ || CanCastle(board)) {
+    return {};
+  }
+  if (IsDeadDraw(board)) {
+    return 0;
+  }
+  return {};
+}
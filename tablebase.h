@@ -0,0 +1,61 @@
+#ifndef TABLEBASE_H_
+#define TABLEBASE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "board.h"
+
+// Win, draw or loss for the side to move, as Syzygy tables store it. Cursed
+// wins and blessed losses are wins and losses the fifty-move rule turns into
+// draws.
+enum class Wdl { kLoss, kBlessedLoss, kDraw, kCursedWin, kWin };
+
+// Syzygy endgame tables (.rtbw for win/draw/loss, .rtbz for distance to
+// zeroing), mapped into memory rather than read, so that opening them costs
+// nothing and only the pages probed are ever loaded.
+class Tablebases {
+ public:
+  // Maps the tables in `paths`, directories separated by ':'. Files whose
+  // name isn't a material signature like KRPvKR, or that don't start with
+  // the magic bytes of their kind, are skipped.
+  static std::unique_ptr<Tablebases> Open(const std::string& paths);
+  ~Tablebases();
+  Tablebases(const Tablebases&) = delete;
+  Tablebases& operator=(const Tablebases&) = delete;
+
+  // The most pieces, kings included, of any win/draw/loss table. Positions
+  // with more are never probed.
+  int Cardinality() const;
+  size_t NumTables() const;
+
+  // The result of `board` with best play, if the tables answer it. Positions
+  // that can still castle aren't in the tables. Decoding the compressed
+  // tables isn't supported yet, so for now only positions any table would
+  // call dead draws are answered, from the material alone.
+  std::optional<Wdl> ProbeWdl(const Board& board) const;
+  // Plies to the next capture or pawn move with best play: positive when the
+  // side to move wins, negative when it loses, 0 for a draw.
+  std::optional<int> ProbeDtz(const Board& board) const;
+
+ private:
+  struct Table {
+    const uint8_t* data;
+    size_t size;
+  };
+
+  Tablebases() = default;
+
+  // By material signature.
+  std::map<std::string, Table> wdl_;
+  std::map<std::string, Table> dtz_;
+  int cardinality_ = 0;
+};
+
+int CountPieces(const Board& board);
+
+#endif  // TABLEBASE_H_
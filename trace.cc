@@ -0,0 +1,114 @@
+#include "trace.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Per thread, a power of two. 32 MiB of events, allocated on the first one.
+const uint64_t kTraceEvents = 1 << 20;
+
+struct TraceEvent {
+  const char* name;
+  uint64_t start_ns;
+  uint64_t duration_ns;
+  int64_t arg;
+  char phase;
+};
+
+struct TraceBuffer {
+  int thread;
+  // Events ever recorded, only the last kTraceEvents are kept.
+  std::atomic<uint64_t> recorded{0};
+  std::vector<TraceEvent> events = std::vector<TraceEvent>(kTraceEvents);
+};
+
+std::mutex& BuffersMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+// Buffers outlive their threads, so that a trace can be written after the
+// search threads are gone.
+std::vector<std::unique_ptr<TraceBuffer>>& Buffers() {
+  static std::vector<std::unique_ptr<TraceBuffer>> buffers;
+  return buffers;
+}
+
+TraceBuffer& ThisThreadBuffer() {
+  thread_local TraceBuffer* buffer = []() {
+    std::lock_guard<std::mutex> lock(BuffersMutex());
+    auto& buffers = Buffers();
+    buffers.push_back(std::make_unique<TraceBuffer>());
+    buffers.back()->thread = buffers.size();
+    return buffers.back().get();
+  }();
+  return *buffer;
+}
+
+std::string& TracePath() {
+  static std::string path;
+  return path;
+}
+
+void WriteTraceFile() {
+  std::ofstream out(TracePath());
+  WriteTrace(out);
+  if (!out) {
+    std::cerr << "Could not write trace to " << TracePath() << std::endl;
+  }
+}
+
+}  // namespace
+
+void RecordTraceEvent(const char* name, char phase, uint64_t start_ns,
+                      uint64_t duration_ns, int64_t arg) {
+  TraceBuffer& buffer = ThisThreadBuffer();
+  uint64_t index = buffer.recorded.load(std::memory_order_relaxed);
+  buffer.events[index & (kTraceEvents - 1)] = {name, start_ns, duration_ns,
+                                               arg, phase};
+  buffer.recorded.store(index + 1, std::memory_order_release);
+}
+
+void WriteTrace(std::ostream& out) {
+  std::lock_guard<std::mutex> lock(BuffersMutex());
+  out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  out << std::fixed << std::setprecision(3);
+  bool first = true;
+  for (const auto& buffer : Buffers()) {
+    uint64_t recorded = buffer->recorded.load(std::memory_order_acquire);
+    uint64_t begin = recorded > kTraceEvents ? recorded - kTraceEvents : 0;
+    for (uint64_t i = begin; i < recorded; ++i) {
+      const TraceEvent& event = buffer->events[i & (kTraceEvents - 1)];
+      out << (first ? "\n" : ",\n") << "{\"name\":\"" << event.name
+          << "\",\"ph\":\"" << event.phase
+          << "\",\"ts\":" << event.start_ns / 1000.0;
+      if (event.phase == 'X') {
+        out << ",\"dur\":" << event.duration_ns / 1000.0;
+      } else {
+        out << ",\"s\":\"t\"";
+      }
+      out << ",\"pid\":1,\"tid\":" << buffer->thread
+          << ",\"args\":{\"value\":" << event.arg << "}}";
+      first = false;
+    }
+  }
+  out << "\n]}" << std::endl;
+  out.unsetf(std::ios::fixed);
+}
+
+void WriteTraceAtExit(const std::string& path) {
+  // Constructed before the handler is registered, so destroyed after it runs.
+  BuffersMutex();
+  Buffers();
+  TracePath() = path;
+  std::atexit(WriteTraceFile);
+}
@@ -0,0 +1,65 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+// Search tracing, compiled in when CHESS_TRACE is defined (configure with
+// -DCHESS_TRACE=ON). Without it the TRACE_ macros expand to nothing and
+// don't evaluate their arguments.
+//
+// Each thread records into its own ring buffer, which keeps its most recent
+// events. Nothing is locked on the way in, only the first event of a thread
+// registers its buffer.
+
+// Nanoseconds since the program started.
+inline uint64_t TraceNow() {
+  static const auto start = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// `phase` is 'X' for a span of `duration_ns`, or 'i' for an instant.
+void RecordTraceEvent(const char* name, char phase, uint64_t start_ns,
+                      uint64_t duration_ns, int64_t arg);
+
+// Writes the recorded events as Chrome trace-event JSON, which Perfetto
+// (ui.perfetto.dev) and chrome://tracing open. Threads must not be tracing
+// at the same time.
+void WriteTrace(std::ostream& out);
+
+// Writes the trace to `path` when the program exits.
+void WriteTraceAtExit(const std::string& path);
+
+// Records a span from its construction to the end of the scope.
+class TraceScope {
+ public:
+  TraceScope(const char* name, int64_t arg)
+      : name_(name), arg_(arg), start_(TraceNow()) {}
+  ~TraceScope() {
+    RecordTraceEvent(name_, 'X', start_, TraceNow() - start_, arg_);
+  }
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+ private:
+  const char* name_;
+  int64_t arg_;
+  uint64_t start_;
+};
+
+#ifdef CHESS_TRACE
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name, arg) \
+  TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name, arg)
+#define TRACE_INSTANT(name, arg) RecordTraceEvent(name, 'i', TraceNow(), 0, arg)
+#else
+#define TRACE_SCOPE(name, arg) ((void)0)
+#define TRACE_INSTANT(name, arg) ((void)0)
+#endif
+
+#endif  // TRACE_H_
@@ -0,0 +1,260 @@
+#include "uci.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "board.h"
+#include "cache.h"
+#include "color.h"
+#include "engine.h"
+#include "input.h"
+#include "mate.h"
+#include "move.h"
+#include "polyglot.h"
+#include "score.h"
+#include "searcher.h"
+#include "tablebase.h"
+
+namespace {
+
+// How many more moves a game is assumed to last, without a "movestogo".
+const int kMovesToGo = 30;
+
+// Lines come from both the protocol loop and the search thread.
+void Send(const std::string& line) {
+  static std::mutex mutex;
+  std::lock_guard<std::mutex> lock(mutex);
+  std::cout << line << std::endl;
+}
+
+// From the side to move, in centipawns or in moves to mate.
+std::string UciScore(Score score, Color color) {
+  int relative = color == kWhite ? score : -score;
+  if (!IsMateScore(score)) {
+    return "cp " + std::to_string(relative);
+  }
+  int moves = (kMate - std::abs(score) + 1) / 2;
+  return "mate " + std::to_string(relative > 0 ? moves : -moves);
+}
+
+// "position startpos|fen <fen> [moves <move>...]"
+std::optional<Board> ParsePosition(const std::string& line) {
+  std::istringstream in(line);
+  std::string token;
+  in >> token >> token;
+  std::optional<Board> board;
+  if (token == "startpos") {
+    board.emplace();
+    in >> token;
+  } else if (token == "fen") {
+    std::string fen;
+    while (in >> token && token != "moves") {
+      fen += ' ';
+      fen += token;
+    }
+    board = Board::FromFen(fen);
+  }
+  if (!board.has_value()) {
+    return {};
+  }
+  while (token == "moves" && in >> token) {
+    auto move = Move::FromXboardString(token);
+    if (!move.has_value() || !board->IsLegalMove(*move)) {
+      return {};
+    }
+    board->DoMove(*move);
+    board->NewTurn();
+    token = "moves";
+  }
+  return board;
+}
+
+// Starts the search a "go" asks for. It reports each iteration, and the best
+// move when it's done or stopped.
+void Go(const std::string& line, const Board& board, Searcher& searcher,
+        AnyUtility& utility, Cache& cache, const Tablebases* tablebases) {
+  std::istringstream in(line);
+  std::string token;
+  in >> token;
+  int max_depth = kMaxDepth;
+  // "go mate <moves>" looks for the mate first, and searches as usual only
+  // if it finds none.
+  std::optional<int> mate_moves;
+  SearchLimits limits;
+  limits.tablebases = tablebases;
+  std::optional<int64_t> move_time;
+  int64_t times[2] = {0, 0};
+  int64_t increments[2] = {0, 0};
+  int moves_to_go = kMovesToGo;
+  bool timed = false;
+  while (in >> token) {
+    int64_t value = 0;
+    if (token == "depth" && in >> value) {
+      max_depth = std::max<int64_t>(value, 1) - 1;
+    } else if (token == "mate" && in >> value) {
+      mate_moves = std::max<int64_t>(value, 1);
+    } else if (token == "nodes" && in >> value) {
+      limits.max_nodes = value;
+    } else if (token == "movetime" && in >> value) {
+      move_time = value;
+    } else if (token == "wtime" && in >> value) {
+      times[kWhite] = value;
+      timed = true;
+    } else if (token == "btime" && in >> value) {
+      times[kBlack] = value;
+      timed = true;
+    } else if (token == "winc" && in >> value) {
+      increments[kWhite] = value;
+    } else if (token == "binc" && in >> value) {
+      increments[kBlack] = value;
+    } else if (token == "movestogo" && in >> value) {
+      moves_to_go = std::max<int64_t>(value, 1);
+    }
+  }
+  Color color = board.CurrentPlayer();
+  if (!move_time.has_value() && timed) {
+    int64_t time = times[color];
+    move_time = std::min(time / moves_to_go + increments[color] / 2, time / 2);
+  }
+  auto start = std::chrono::steady_clock::now();
+  if (move_time.has_value()) {
+    limits.deadline = start + std::chrono::milliseconds(*move_time);
+  }
+
+  searcher.Start([board = Board(board), color, max_depth, mate_moves, limits,
+                  start, &utility, &cache](const std::atomic<bool>* stop) mutable {
+    limits.stop = stop;
+    if (mate_moves.has_value()) {
+      if (auto mate = FindMate(board, *mate_moves, limits)) {
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        std::ostringstream info;
+        info << "info depth " << mate->size() << " score mate "
+             << (mate->size() + 1) / 2 << " nodes " << limits.nodes
+             << " time " << static_cast<int64_t>(elapsed.count() * 1000)
+             << " pv";
+        for (const Move& move : *mate) {
+          info << " " << move.XboardString();
+        }
+        Send(info.str());
+        Send("bestmove " + mate->front().XboardString());
+        return;
+      }
+      // What's left of the limits, if anything, goes to the usual search.
+      Send("info string No mate found in " + std::to_string(*mate_moves));
+    }
+    auto report = [&](int depth, const std::vector<Move>& moves) {
+      const Move& best = moves.back();
+      std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+      std::ostringstream info;
+      info << "info depth " << depth + 1 << " seldepth "
+           << limits.stats.selective_depth << " score "
+           << UciScore(best.Utility(), color) << " nodes " << limits.nodes
+           << " nps "
+           << static_cast<uint64_t>(limits.nodes /
+                                    std::max(elapsed.count(), 1e-9))
+           << " time " << static_cast<int64_t>(elapsed.count() * 1000)
+           << " tbhits " << limits.stats.tablebase_hits << " pv";
+      for (const Move& move : PrincipalVariation(board, best, cache, depth + 1)) {
+        info << " " << move.XboardString();
+      }
+      Send(info.str());
+    };
+    auto moves = SearchIteratively(board, color, max_depth, utility, cache,
+                                   limits, report);
+    if (moves.empty()) {
+      Send("bestmove 0000");
+      return;
+    }
+    auto pv = PrincipalVariation(board, moves.back(), cache, 2);
+    std::string bestmove = "bestmove " + moves.back().XboardString();
+    if (pv.size() > 1) {
+      bestmove += " ponder ";
+      bestmove += pv[1].XboardString();
+    }
+    Send(bestmove);
+  });
+}
+
+}  // namespace
+
+void RunUci(MessageQueue& queue, AnyUtility& utility, Cache& cache,
+            PolyglotBook* book, const Tablebases* tablebases) {
+  Searcher searcher;
+  Board board;
+  // Replaces `tablebases` once the GUI sets SyzygyPath.
+  std::unique_ptr<Tablebases> syzygy;
+  auto identify = []() {
+    Send("id name chess");
+    Send("option name Hash type spin default " +
+         std::to_string(kDefaultCacheMegabytes) + " min 1 max 65536");
+    Send("option name SyzygyPath type string default <empty>");
+    Send("uciok");
+  };
+  identify();
+  while (true) {
+    Message message = queue.Pop();
+    if (message.type != Message::kInput) {
+      continue;
+    }
+    std::istringstream in(message.line);
+    std::string command;
+    in >> command;
+    if (command == "quit") {
+      searcher.Stop();
+      return;
+    } else if (command == "uci") {
+      identify();
+    } else if (command == "setoption") {
+      // "setoption name <name> value <value>"
+      std::string name, path;
+      in >> name >> name >> path >> path;
+      if (name == "Hash") {
+        searcher.Stop();
+        cache.Resize(std::max(atoi(path.c_str()), 1));
+      } else if (name == "SyzygyPath") {
+        searcher.Stop();
+        syzygy = Tablebases::Open(path == "<empty>" ? "" : path);
+        tablebases = syzygy.get();
+        Send("info string Found " + std::to_string(syzygy->NumTables()) +
+             " tablebases");
+      }
+    } else if (command == "isready") {
+      Send("readyok");
+    } else if (command == "ucinewgame") {
+      searcher.Stop();
+      cache.NewGame();
+      board = Board();
+    } else if (command == "position") {
+      searcher.Stop();
+      auto position = ParsePosition(message.line);
+      if (!position.has_value()) {
+        Send("info string Illegal position: " + message.line);
+        continue;
+      }
+      board = std::move(*position);
+    } else if (command == "go") {
+      searcher.Stop();
+      if (book != nullptr) {
+        if (auto move = book->Probe(board)) {
+          Send("bestmove " + move->XboardString());
+          continue;
+        }
+      }
+      Go(message.line, board, searcher, utility, cache, tablebases);
+    } else if (command == "stop") {
+      searcher.RequestStop();
+    }
+  }
+}
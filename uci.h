@@ -0,0 +1,18 @@
+#ifndef UCI_H_
+#define UCI_H_
+
+#include "cache.h"
+#include "engine.h"
+#include "input.h"
+#include "polyglot.h"
+#include "tablebase.h"
+
+// Speaks UCI, once "uci" has picked it, to the GUI whose commands arrive on
+// `queue`. Searches run on their own thread, so "stop" and "isready" are
+// answered while searching. Positions in `book`, if there is one, are played
+// from it without searching. Searches probe `tablebases`, or the ones the
+// SyzygyPath option names. Returns at "quit".
+void RunUci(MessageQueue& queue, AnyUtility& utility, Cache& cache,
+            PolyglotBook* book, const Tablebases* tablebases);
+
+#endif  // UCI_H_